@@ -0,0 +1,171 @@
+#include "bench_utils.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+
+#include <sys/resource.h>
+
+namespace {
+
+std::atomic<size_t> allocations{0};
+
+void* counted_allocate(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* counted_allocate(size_t size, std::align_val_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t align = static_cast<size_t>(alignment);
+    size = (size + align - 1) / align * align;
+    if (void* ptr = std::aligned_alloc(align, size == 0 ? align : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void print_usage(const char* name) {
+    std::cout << "usage: " << name << " [--min-size N] [--max-size N] [--min-ops N] [--stale-max-size N]\n"
+              << "       [--seed S] [--filter TEXT] [--csv]\n"
+              << "  sizes run in powers of ten from --min-size (default 1000) to --max-size (default 1000000),\n"
+              << "  stale iterator benchmarks only run up to --stale-max-size (default 10000) elements,\n"
+              << "  --filter keeps rows whose container/key/benchmark contains TEXT\n";
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+    return counted_allocate(size);
+}
+
+void* operator new[](size_t size) {
+    return counted_allocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    return counted_allocate(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return counted_allocate(size, alignment);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+namespace bench {
+
+bench_options parse_options(int argc, char** argv) {
+    bench_options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                print_usage(argv[0]);
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+        if (arg == "--min-size") {
+            options.min_size = std::stoull(value());
+        } else if (arg == "--max-size") {
+            options.max_size = std::stoull(value());
+        } else if (arg == "--min-ops") {
+            options.min_ops = std::stoull(value());
+        } else if (arg == "--stale-max-size") {
+            options.stale_max_size = std::stoull(value());
+        } else if (arg == "--seed") {
+            options.seed = static_cast<unsigned>(std::stoul(value()));
+        } else if (arg == "--filter") {
+            options.filter = value();
+        } else if (arg == "--csv") {
+            options.csv = true;
+        } else {
+            print_usage(argv[0]);
+            std::exit(arg == "--help" ? 0 : 1);
+        }
+    }
+    return options;
+}
+
+std::vector<size_t> bench_sizes(const bench_options& options) {
+    std::vector<size_t> sizes;
+    for (size_t n = options.min_size; n <= options.max_size; n *= 10) {
+        sizes.push_back(n);
+    }
+    return sizes;
+}
+
+size_t allocation_count() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+size_t peak_rss_kb() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss);
+}
+
+bench_report::bench_report(const bench_options& options) : options_(options) {
+    if (options_.csv) {
+        std::cout << "container,key,benchmark,n,ns_per_op,allocs_per_op,peak_rss_kb" << std::endl;
+    } else {
+        std::cout << std::left << std::setw(22) << "container" << std::setw(18) << "key" << std::setw(24) << "benchmark"
+                  << std::right << std::setw(10) << "n" << std::setw(12) << "ns/op" << std::setw(12) << "allocs/op"
+                  << std::setw(14) << "peak RSS MB" << std::endl;
+    }
+}
+
+bool bench_report::enabled(const std::string& container, const std::string& key, const std::string& name) const {
+    return options_.filter.empty() || (container + "/" + key + "/" + name).find(options_.filter) != std::string::npos;
+}
+
+void bench_report::add(const std::string& container, const std::string& key, const std::string& name, size_t n,
+                       const measurement& result) {
+    if (options_.csv) {
+        std::cout << container << "," << key << "," << name << "," << n << "," << result.ns_per_op << ","
+                  << result.allocs_per_op << "," << peak_rss_kb() << std::endl;
+    } else {
+        std::cout << std::left << std::setw(22) << container << std::setw(18) << key << std::setw(24) << name
+                  << std::right << std::setw(10) << n << std::fixed << std::setprecision(1) << std::setw(12)
+                  << result.ns_per_op << std::setprecision(2) << std::setw(12) << result.allocs_per_op
+                  << std::setprecision(1) << std::setw(14) << peak_rss_kb() / 1024.0 << std::endl;
+    }
+}
+
+} // bench
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "utils.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+struct bench_options {
+    size_t min_size = 1000;
+    size_t max_size = 1000000;
+    size_t min_ops = 1000000;
+    size_t stale_max_size = 10000;
+    unsigned seed = 42;
+    std::string filter;
+    bool csv = false;
+};
+
+bench_options parse_options(int argc, char** argv);
+
+std::vector<size_t> bench_sizes(const bench_options& options);
+
+size_t allocation_count();
+
+size_t peak_rss_kb();
+
+// Values holding iterators of refcounted containers trip GCC 12's use-after-free analysis once the
+// release of a previous iterator is inlined into the same loop.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuse-after-free"
+#endif
+template <class T>
+inline void do_not_optimize(T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+#pragma GCC diagnostic pop
+#endif
+
+struct measurement {
+    double ns_per_op = 0;
+    double allocs_per_op = 0;
+};
+
+class stopwatch {
+public:
+    void start() {
+        allocations_ = allocation_count();
+        start_ = std::chrono::steady_clock::now();
+    }
+    void stop() {
+        auto finish = std::chrono::steady_clock::now();
+        elapsed_ns_ += std::chrono::duration<double, std::nano>(finish - start_).count();
+        allocated_ += allocation_count() - allocations_;
+    }
+    measurement result(size_t ops) const {
+        return {elapsed_ns_ / ops, static_cast<double>(allocated_) / ops};
+    }
+private:
+    std::chrono::steady_clock::time_point start_;
+    double elapsed_ns_ = 0;
+    size_t allocations_ = 0;
+    size_t allocated_ = 0;
+};
+
+inline size_t repetitions(const bench_options& options, size_t n) {
+    return std::max<size_t>(1, options.min_ops / std::max<size_t>(1, n));
+}
+
+// Runs `run` on a fresh state produced by `setup` for every repetition, only `run` is timed.
+template <class Setup, class Run>
+measurement measure_fresh(const bench_options& options, size_t n, Setup setup, Run run) {
+    size_t reps = repetitions(options, n);
+    stopwatch watch;
+    for (size_t i = 0; i < reps; i++) {
+        auto state = setup();
+        watch.start();
+        run(state);
+        watch.stop();
+    }
+    return watch.result(reps * n);
+}
+
+// Runs `run` repeatedly on the same state, for read only workloads.
+template <class Run>
+measurement measure_repeat(const bench_options& options, size_t n, Run run) {
+    size_t reps = repetitions(options, n);
+    stopwatch watch;
+    watch.start();
+    for (size_t i = 0; i < reps; i++) {
+        run();
+    }
+    watch.stop();
+    return watch.result(reps * n);
+}
+
+class bench_report {
+public:
+    explicit bench_report(const bench_options& options);
+    bool enabled(const std::string& container, const std::string& key, const std::string& name) const;
+    void add(const std::string& container, const std::string& key, const std::string& name, size_t n,
+             const measurement& result);
+private:
+    const bench_options& options_;
+};
+
+template <class Key>
+struct key_set {
+    std::vector<Key> hits;
+    std::vector<Key> misses;
+};
+
+// Produces `n` distinct keys to insert and `n` distinct keys that are guaranteed to be absent,
+// both in a deterministic shuffled order.
+template <class Key, class Generator>
+key_set<Key> make_key_set(size_t n, unsigned seed, Generator& generator) {
+    std::vector<Key> keys;
+    keys.reserve(2 * n);
+    while (keys.size() < 2 * n) {
+        while (keys.size() < 2 * n + 2 * n / 16 + 16) {
+            keys.push_back(generator.next_value());
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(seed));
+    key_set<Key> result;
+    result.hits.assign(std::make_move_iterator(keys.begin()), std::make_move_iterator(keys.begin() + n));
+    result.misses.assign(std::make_move_iterator(keys.begin() + n), std::make_move_iterator(keys.begin() + 2 * n));
+    return result;
+}
+
+} // bench
@@ -0,0 +1,94 @@
+#include "acid_map.hpp"
+#include "bench_utils.hpp"
+#include "checkpoint.hpp"
+
+#include <climits>
+#include <filesystem>
+#include <unistd.h>
+
+using bench::bench_options;
+using bench::bench_report;
+using bench::key_set;
+
+// Compares the ways a process can get its map back after a restart: re-inserting every element, as a
+// replayed log would, opening a checkpoint for lookups, and materializing the tree from a checkpoint.
+// open+find is the time to the first answered lookup and is reported per open, not per element.
+int main(int argc, char** argv) {
+    bench_options options = bench::parse_options(argc, argv);
+    bench_report report(options);
+    auto sizes = bench::bench_sizes(options);
+    if (sizes.empty()) {
+        return 0;
+    }
+    std::string path =
+        (std::filesystem::temp_directory_path() / ("checkpoint_bench_" + std::to_string(::getpid()))).string();
+    int_generator generator(INT_MIN, INT_MAX, options.seed);
+    key_set<int> keys = bench::make_key_set<int>(sizes.back(), options.seed, generator);
+    for (size_t n : sizes) {
+        auto fill = [&] {
+            auto map = std::make_unique<polyndrom::acid_map<int, int>>();
+            for (size_t i = 0; i < n; i++) {
+                (*map)[keys.hits[i]] = static_cast<int>(i);
+            }
+            return map;
+        };
+        if (report.enabled("acid_map", "int", "reinsert")) {
+            report.add("acid_map", "int", "reinsert", n, bench::measure_fresh(options, n, [] {
+                return 0;
+            }, [&](int) {
+                auto map = fill();
+                bench::do_not_optimize(map);
+            }));
+        }
+        auto source = fill();
+        if (report.enabled("checkpoint", "int", "write")) {
+            report.add("checkpoint", "int", "write", n, bench::measure_fresh(options, n, [] {
+                return 0;
+            }, [&](int) {
+                polyndrom::write_checkpoint(path, *source);
+            }));
+        }
+        polyndrom::write_checkpoint(path, *source);
+        if (report.enabled("checkpoint", "int", "open+find")) {
+            bench::stopwatch watch;
+            size_t reps = std::max<size_t>(1, bench::repetitions(options, n) * n / 1000);
+            watch.start();
+            for (size_t i = 0; i < reps; i++) {
+                polyndrom::checkpoint_view<int, int> view(path);
+                bool found = view.contains(keys.hits[i % n]);
+                bench::do_not_optimize(found);
+            }
+            watch.stop();
+            report.add("checkpoint", "int", "open+find", n, watch.result(reps));
+        }
+        polyndrom::checkpoint_view<int, int> view(path);
+        if (report.enabled("checkpoint", "int", "find_hit")) {
+            report.add("checkpoint", "int", "find_hit", n, bench::measure_repeat(options, n, [&] {
+                size_t found = 0;
+                for (size_t i = 0; i < n; i++) {
+                    found += view.contains(keys.hits[i]);
+                }
+                bench::do_not_optimize(found);
+            }));
+        }
+        if (report.enabled("acid_map", "int", "find_hit")) {
+            report.add("acid_map", "int", "find_hit", n, bench::measure_repeat(options, n, [&] {
+                size_t found = 0;
+                for (size_t i = 0; i < n; i++) {
+                    found += source->contains(keys.hits[i]);
+                }
+                bench::do_not_optimize(found);
+            }));
+        }
+        if (report.enabled("checkpoint", "int", "materialize")) {
+            report.add("checkpoint", "int", "materialize", n, bench::measure_fresh(options, n, [] {
+                return 0;
+            }, [&](int) {
+                auto map = view.materialize();
+                bench::do_not_optimize(map);
+            }));
+        }
+    }
+    std::filesystem::remove(path);
+    return 0;
+}
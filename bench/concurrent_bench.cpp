@@ -0,0 +1,369 @@
+#include "acid_map.hpp"
+#include "bench_utils.hpp"
+#include "concurrent_acid_map.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+
+using bench::bench_options;
+using bench::bench_report;
+using bench::key_set;
+
+// The baseline every concurrent container is compared against: a plain acid_map behind one mutex.
+template <class Key, class T>
+class locked_acid_map {
+public:
+    bool emplace(const Key& key, const T& value) {
+        std::lock_guard lock(mutex);
+        return map.emplace(key, value).second;
+    }
+    size_t erase(const Key& key) {
+        std::lock_guard lock(mutex);
+        return map.erase(key);
+    }
+    bool contains(const Key& key) const {
+        std::lock_guard lock(mutex);
+        return map.contains(key);
+    }
+    template <class F>
+    void update(F f) {
+        std::lock_guard lock(mutex);
+        f(map);
+    }
+private:
+    mutable std::mutex mutex;
+    polyndrom::acid_map<Key, T> map;
+};
+
+struct workload {
+    std::string name;
+    unsigned lookup_percent;
+    unsigned insert_percent;
+};
+
+enum class operation : unsigned char { lookup, insert, erase };
+
+struct thread_ops {
+    std::vector<operation> kinds;
+    std::vector<size_t> keys;
+};
+
+// Draws the operations of every thread up front so the timed loop only touches the map. Keys come
+// from hits and misses alike, which keeps about half of the lookups successful and the size steady.
+std::vector<thread_ops> make_thread_ops(const workload& load, size_t threads, size_t ops, size_t key_count,
+                                        unsigned seed) {
+    std::vector<thread_ops> result(threads);
+    for (size_t t = 0; t < threads; t++) {
+        std::mt19937 random(seed + static_cast<unsigned>(t));
+        std::uniform_int_distribution<unsigned> percent(0, 99);
+        std::uniform_int_distribution<size_t> key(0, key_count - 1);
+        result[t].kinds.reserve(ops);
+        result[t].keys.reserve(ops);
+        for (size_t i = 0; i < ops; i++) {
+            unsigned p = percent(random);
+            operation kind = p < load.lookup_percent ? operation::lookup
+                             : p < load.lookup_percent + load.insert_percent ? operation::insert
+                                                                              : operation::erase;
+            result[t].kinds.push_back(kind);
+            result[t].keys.push_back(key(random));
+        }
+    }
+    return result;
+}
+
+template <class Map, class Key>
+bench::measurement run_threads(Map& map, const std::vector<Key>& keys, const std::vector<thread_ops>& ops) {
+    std::vector<std::thread> workers;
+    workers.reserve(ops.size());
+    size_t total = 0;
+    for (const thread_ops& thread : ops) {
+        total += thread.kinds.size();
+    }
+    bench::stopwatch watch;
+    watch.start();
+    for (const thread_ops& thread : ops) {
+        workers.emplace_back([&map, &keys, &thread] {
+            size_t found = 0;
+            for (size_t i = 0; i < thread.kinds.size(); i++) {
+                const Key& key = keys[thread.keys[i]];
+                switch (thread.kinds[i]) {
+                case operation::lookup:
+                    found += map.contains(key);
+                    break;
+                case operation::insert:
+                    found += map.emplace(key, static_cast<int>(i));
+                    break;
+                case operation::erase:
+                    found += map.erase(key);
+                    break;
+                }
+            }
+            bench::do_not_optimize(found);
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    watch.stop();
+    return watch.result(total);
+}
+
+// Readers only look keys up while one extra thread keeps inserting and erasing, ns/op counts reader
+// operations only.
+template <class Map, class Key>
+bench::measurement run_readers_with_writer(Map& map, const std::vector<Key>& keys, const std::vector<thread_ops>& ops) {
+    std::atomic<bool> done{false};
+    std::thread writer([&] {
+        for (size_t i = 0; !done.load(std::memory_order_relaxed); i++) {
+            const Key& key = keys[i % keys.size()];
+            if (!map.emplace(key, static_cast<int>(i))) {
+                map.erase(key);
+            }
+        }
+    });
+    bench::measurement result = run_threads(map, keys, ops);
+    done = true;
+    writer.join();
+    return result;
+}
+
+template <class Map, class Key>
+void run_concurrent_suite(const bench_options& options, bench_report& report, const std::string& container,
+                          const std::string& key_name, const key_set<Key>& keys, const std::vector<Key>& all_keys,
+                          size_t n, const std::vector<size_t>& thread_counts) {
+    const workload workloads[] = {{"read_heavy", 90, 5}, {"mixed", 50, 25}};
+    for (const workload& load : workloads) {
+        for (size_t threads : thread_counts) {
+            std::string name = load.name + "/" + std::to_string(threads) + "t";
+            if (!report.enabled(container, key_name, name)) {
+                continue;
+            }
+            auto map = std::make_unique<Map>();
+            for (size_t i = 0; i < n; i++) {
+                map->emplace(keys.hits[i], static_cast<int>(i));
+            }
+            size_t ops = std::max<size_t>(1, options.min_ops / threads);
+            auto thread_ops = make_thread_ops(load, threads, ops, 2 * n, options.seed);
+            report.add(container, key_name, name, n, run_threads(*map, all_keys, thread_ops));
+        }
+    }
+    const workload lookups{"find+writer", 100, 0};
+    for (size_t threads : thread_counts) {
+        std::string name = lookups.name + "/" + std::to_string(threads) + "t";
+        if (!report.enabled(container, key_name, name)) {
+            continue;
+        }
+        auto map = std::make_unique<Map>();
+        for (size_t i = 0; i < n; i++) {
+            map->emplace(keys.hits[i], static_cast<int>(i));
+        }
+        size_t ops = std::max<size_t>(1, options.min_ops / threads);
+        auto thread_ops = make_thread_ops(lookups, threads, ops, 2 * n, options.seed);
+        report.add(container, key_name, name, n, run_readers_with_writer(*map, all_keys, thread_ops));
+    }
+}
+
+struct transfer_result {
+    bench::measurement per_commit;
+    bench::measurement per_attempt;
+};
+
+// Moves one unit between two random accounts per transaction. Fewer accounts mean more conflicts.
+template <class Map>
+transfer_result run_transfers(Map& map, size_t accounts, size_t threads, size_t transfers, unsigned seed) {
+    std::atomic<size_t> attempts{0};
+    std::vector<std::thread> workers;
+    bench::stopwatch watch;
+    watch.start();
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            std::mt19937 random(seed + static_cast<unsigned>(t));
+            std::uniform_int_distribution<int> account(0, static_cast<int>(accounts) - 1);
+            size_t tries = 0;
+            for (size_t i = 0; i < transfers; i++) {
+                int from = account(random);
+                int to = account(random);
+                if constexpr (std::is_same_v<Map, locked_acid_map<int, int>>) {
+                    ++tries;
+                    map.update([&](auto& locked) {
+                        --locked[from];
+                        ++locked[to];
+                    });
+                } else {
+                    while (true) {
+                        ++tries;
+                        auto tx = map.begin_transaction();
+                        tx.insert_or_assign(from, *tx.get(from) - 1);
+                        tx.insert_or_assign(to, *tx.get(to) + 1);
+                        if (tx.commit()) {
+                            break;
+                        }
+                    }
+                }
+            }
+            attempts += tries;
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    watch.stop();
+    return {watch.result(threads * transfers), watch.result(attempts)};
+}
+
+template <class Map>
+void run_transfer_suite(const bench_options& options, bench_report& report, const std::string& container,
+                        const std::vector<size_t>& thread_counts) {
+    for (size_t accounts : {16, 256, 65536}) {
+        for (size_t threads : thread_counts) {
+            std::string suffix = "/" + std::to_string(threads) + "t";
+            if (!report.enabled(container, "int", "transfer" + suffix)) {
+                continue;
+            }
+            Map map;
+            for (size_t i = 0; i < accounts; i++) {
+                map.emplace(static_cast<int>(i), 0);
+            }
+            size_t transfers = std::max<size_t>(1, options.min_ops / 4 / threads);
+            transfer_result result = run_transfers(map, accounts, threads, transfers, options.seed);
+            report.add(container, "int", "transfer" + suffix, accounts, result.per_commit);
+            report.add(container, "int", "transfer_attempt" + suffix, accounts, result.per_attempt);
+        }
+    }
+}
+
+// Reconciles a map of n keys with a second one sharing half of them, per element of the second map, the set
+// operations running on a pool of the given size. The insert row is the serial loop they replace.
+void run_set_operation_suite(const bench_options& options, bench_report& report, const key_set<int>& keys, size_t n,
+                             const std::vector<size_t>& thread_counts) {
+    using map_type = polyndrom::acid_map<int, int>;
+    auto sorted_values = [](std::vector<int> keys) {
+        std::sort(keys.begin(), keys.end());
+        std::vector<std::pair<int, int>> values;
+        for (int key : keys) {
+            values.emplace_back(key, key);
+        }
+        return values;
+    };
+    auto base = sorted_values(std::vector<int>(keys.hits.begin(), keys.hits.begin() + n));
+    std::vector<int> other_keys(keys.hits.begin() + n / 2, keys.hits.begin() + n);
+    other_keys.insert(other_keys.end(), keys.misses.begin(), keys.misses.begin() + n / 2);
+    auto other_values = sorted_values(other_keys);
+    map_type other(polyndrom::sorted_unique, other_values.begin(), other_values.end());
+    auto fresh_map = [&] {
+        return std::make_unique<map_type>(polyndrom::sorted_unique, base.begin(), base.end());
+    };
+    auto add = [](int& value, int added) {
+        value += added;
+    };
+    if (report.enabled("acid_map", "int", "unite_by_insert")) {
+        report.add("acid_map", "int", "unite_by_insert", n,
+                   bench::measure_fresh(options, other.size(), fresh_map, [&](std::unique_ptr<map_type>& map) {
+            for (auto& [key, value] : other) {
+                auto [it, inserted] = map->emplace(key, value);
+                if (!inserted) {
+                    it->second += value;
+                }
+            }
+        }));
+    }
+    for (size_t threads : thread_counts) {
+        std::string suffix = "/" + std::to_string(threads) + "t";
+        polyndrom::work_stealing_pool pool(threads);
+        if (report.enabled("acid_map", "int", "unite" + suffix)) {
+            report.add("acid_map", "int", "unite" + suffix, n,
+                       bench::measure_fresh(options, other.size(), fresh_map, [&](std::unique_ptr<map_type>& map) {
+                map->unite(other, add, &pool);
+            }));
+        }
+        if (report.enabled("acid_map", "int", "intersect" + suffix)) {
+            report.add("acid_map", "int", "intersect" + suffix, n,
+                       bench::measure_fresh(options, other.size(), fresh_map, [&](std::unique_ptr<map_type>& map) {
+                map->intersect(other, &pool);
+            }));
+        }
+        if (report.enabled("acid_map", "int", "subtract" + suffix)) {
+            report.add("acid_map", "int", "subtract" + suffix, n,
+                       bench::measure_fresh(options, other.size(), fresh_map, [&](std::unique_ptr<map_type>& map) {
+                map->subtract(other, &pool);
+            }));
+        }
+    }
+}
+
+// Full scans of a map of n keys per element: the iterate row is the single-threaded range-for loop,
+// the others walk the subtrees on a pool of the given size.
+void run_traversal_suite(const bench_options& options, bench_report& report, const key_set<int>& keys, size_t n,
+                         const std::vector<size_t>& thread_counts) {
+    polyndrom::acid_map<int, int> map;
+    for (size_t i = 0; i < n; i++) {
+        map.emplace(keys.hits[i], static_cast<int>(i));
+    }
+    if (report.enabled("acid_map", "int", "iterate")) {
+        report.add("acid_map", "int", "iterate", n, bench::measure_repeat(options, n, [&] {
+            int64_t sum = 0;
+            for (auto& [key, value] : map) {
+                sum += value;
+            }
+            bench::do_not_optimize(sum);
+        }));
+    }
+    for (size_t threads : thread_counts) {
+        std::string suffix = "/" + std::to_string(threads) + "t";
+        polyndrom::work_stealing_pool pool(threads);
+        if (report.enabled("acid_map", "int", "for_each" + suffix)) {
+            report.add("acid_map", "int", "for_each" + suffix, n, bench::measure_repeat(options, n, [&] {
+                polyndrom::parallel_for_each(map, [](auto& value) {
+                    value.second++;
+                }, pool);
+            }));
+        }
+        if (report.enabled("acid_map", "int", "reduce" + suffix)) {
+            report.add("acid_map", "int", "reduce" + suffix, n, bench::measure_repeat(options, n, [&] {
+                int64_t sum = polyndrom::parallel_reduce(map, int64_t(0), std::plus<>(), [](const auto& value) {
+                    return int64_t(value.second);
+                }, pool);
+                bench::do_not_optimize(sum);
+            }));
+        }
+    }
+}
+
+// Every row reports wall time divided by the operations of all threads, so a container that scales
+// shows ns/op falling as threads are added.
+int main(int argc, char** argv) {
+    bench_options options = bench::parse_options(argc, argv);
+    bench_report report(options);
+    std::vector<size_t> thread_counts;
+    size_t max_threads = std::max<size_t>(4, std::thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    auto sizes = bench::bench_sizes(options);
+    if (sizes.empty()) {
+        return 0;
+    }
+    int_generator generator(INT_MIN, INT_MAX, options.seed);
+    key_set<int> keys = bench::make_key_set<int>(sizes.back(), options.seed, generator);
+    for (size_t n : sizes) {
+        std::vector<int> all_keys(keys.hits.begin(), keys.hits.begin() + n);
+        all_keys.insert(all_keys.end(), keys.misses.begin(), keys.misses.begin() + n);
+        run_concurrent_suite<polyndrom::concurrent_acid_map<int, int>>(options, report, "concurrent_acid_map", "int",
+                                                                        keys, all_keys, n, thread_counts);
+        run_concurrent_suite<locked_acid_map<int, int>>(options, report, "acid_map+mutex", "int", keys, all_keys, n,
+                                                        thread_counts);
+        run_set_operation_suite(options, report, keys, n, thread_counts);
+        run_traversal_suite(options, report, keys, n, thread_counts);
+    }
+    run_transfer_suite<polyndrom::concurrent_acid_map<int, int>>(options, report, "concurrent_acid_map", thread_counts);
+    run_transfer_suite<locked_acid_map<int, int>>(options, report, "acid_map+mutex", thread_counts);
+    return 0;
+}
@@ -0,0 +1,449 @@
+#include "acid_btree.hpp"
+#include "acid_map.hpp"
+#include "bench_utils.hpp"
+#include "persistent_acid_map.hpp"
+
+#include <climits>
+#include <map>
+#include <memory>
+
+using bench::bench_options;
+using bench::bench_report;
+using bench::do_not_optimize;
+using bench::key_set;
+using bench::measure_fresh;
+using bench::measure_repeat;
+
+template <class Key, class T>
+using pooled_acid_map = polyndrom::acid_map<Key, T, std::less<Key>,
+                                            polyndrom::node_pool_allocator<std::pair<const Key, T>>>;
+
+template <class Map, class = void>
+struct has_assign_sorted : std::false_type {};
+
+template <class Map>
+struct has_assign_sorted<Map, std::void_t<decltype(std::declval<Map&>().assign_sorted(
+    std::declval<std::pair<typename Map::key_type, int>*>(), std::declval<std::pair<typename Map::key_type, int>*>()))>>
+    : std::true_type {};
+
+template <class Map, class = void>
+struct has_batch_ops : std::false_type {};
+
+template <class Map>
+struct has_batch_ops<Map, std::void_t<decltype(std::declval<Map&>().erase_many(
+    std::declval<typename Map::key_type*>(), std::declval<typename Map::key_type*>()))>> : std::true_type {};
+
+template <class Map, class = void>
+struct has_range : std::false_type {};
+
+template <class Map>
+struct has_range<Map, std::void_t<decltype(std::declval<Map&>().range(
+    std::declval<const typename Map::key_type&>(), std::declval<const typename Map::key_type&>()))>>
+    : std::true_type {};
+
+template <class Map, class = void>
+struct has_range_erase : std::false_type {};
+
+template <class Map>
+struct has_range_erase<Map, std::void_t<decltype(std::declval<Map&>().erase(
+    std::declval<typename Map::iterator>(), std::declval<typename Map::iterator>()))>> : std::true_type {};
+
+constexpr size_t batch_size = 1000;
+constexpr size_t scan_length = 100;
+
+template <class Map, class Key>
+std::unique_ptr<Map> make_filled_map(const key_set<Key>& keys, size_t n) {
+    auto map = std::make_unique<Map>();
+    for (size_t i = 0; i < n; i++) {
+        map->emplace(keys.hits[i], static_cast<int>(i));
+    }
+    return map;
+}
+
+template <class Map, class Key>
+void run_map_suite(const bench_options& options, bench_report& report, const std::string& container,
+                   const std::string& key_name, const key_set<Key>& keys, size_t n) {
+    auto bench = [&](const std::string& name, auto&& measure) {
+        if (report.enabled(container, key_name, name)) {
+            report.add(container, key_name, name, n, measure());
+        }
+    };
+    auto empty_map = [] {
+        return std::make_unique<Map>();
+    };
+    auto filled_map = [&] {
+        return make_filled_map<Map>(keys, n);
+    };
+    bench("insert", [&] {
+        return measure_fresh(options, n, empty_map, [&](std::unique_ptr<Map>& map) {
+            for (size_t i = 0; i < n; i++) {
+                map->insert(std::make_pair(keys.hits[i], static_cast<int>(i)));
+            }
+        });
+    });
+    bench("emplace", [&] {
+        return measure_fresh(options, n, empty_map, [&](std::unique_ptr<Map>& map) {
+            for (size_t i = 0; i < n; i++) {
+                map->emplace(keys.hits[i], static_cast<int>(i));
+            }
+        });
+    });
+    bench("try_emplace", [&] {
+        return measure_fresh(options, n, empty_map, [&](std::unique_ptr<Map>& map) {
+            for (size_t i = 0; i < n; i++) {
+                map->try_emplace(keys.hits[i], static_cast<int>(i));
+            }
+        });
+    });
+    std::vector<std::pair<Key, int>> sorted;
+    for (size_t i = 0; i < n; i++) {
+        sorted.emplace_back(keys.hits[i], static_cast<int>(i));
+    }
+    std::sort(sorted.begin(), sorted.end());
+    bench("insert_sorted", [&] {
+        return measure_fresh(options, n, empty_map, [&](std::unique_ptr<Map>& map) {
+            for (auto& value : sorted) {
+                map->insert(value);
+            }
+        });
+    });
+    bench("build_sorted", [&] {
+        return measure_fresh(options, n, empty_map, [&](std::unique_ptr<Map>& map) {
+            if constexpr (has_assign_sorted<Map>::value) {
+                map->assign_sorted(sorted.begin(), sorted.end());
+            } else {
+                map->insert(sorted.begin(), sorted.end());
+            }
+        });
+    });
+    bench("emplace_existing", [&] {
+        auto map = filled_map();
+        return measure_repeat(options, n, [&] {
+            for (size_t i = 0; i < n; i++) {
+                auto result = map->emplace(keys.hits[i], static_cast<int>(i));
+                do_not_optimize(result);
+            }
+        });
+    });
+    bench("find_hit", [&] {
+        auto map = filled_map();
+        return measure_repeat(options, n, [&] {
+            for (size_t i = 0; i < n; i++) {
+                auto it = map->find(keys.hits[i]);
+                do_not_optimize(it);
+            }
+        });
+    });
+    bench("find_miss", [&] {
+        auto map = filled_map();
+        return measure_repeat(options, n, [&] {
+            for (size_t i = 0; i < n; i++) {
+                auto it = map->find(keys.misses[i]);
+                do_not_optimize(it);
+            }
+        });
+    });
+    bench("lower_bound", [&] {
+        auto map = filled_map();
+        return measure_repeat(options, n, [&] {
+            for (size_t i = 0; i < n; i++) {
+                auto it = map->lower_bound(keys.misses[i]);
+                do_not_optimize(it);
+            }
+        });
+    });
+    bench("range_scan_100", [&] {
+        auto map = filled_map();
+        std::vector<Key> bounds(keys.hits.begin(), keys.hits.begin() + n);
+        std::sort(bounds.begin(), bounds.end());
+        size_t scans = n > scan_length ? n - scan_length : 0;
+        return measure_repeat(options, std::max<size_t>(scans * scan_length, 1), [&] {
+            long long sum = 0;
+            for (size_t i = 0; i < scans; i++) {
+                if constexpr (has_range<Map>::value) {
+                    for (auto& [key, value] : map->range(bounds[i], bounds[i + scan_length])) {
+                        sum += value;
+                    }
+                } else {
+                    auto last = map->end();
+                    for (auto it = map->lower_bound(bounds[i]); it != last && it->first < bounds[i + scan_length]; ++it) {
+                        sum += it->second;
+                    }
+                }
+            }
+            do_not_optimize(sum);
+        });
+    });
+    if constexpr (has_nth<Map>::value) {
+        bench("nth", [&] {
+            auto map = filled_map();
+            return measure_repeat(options, n, [&] {
+                for (size_t i = 0; i < n; i++) {
+                    auto it = map->nth((i * 7919) % n);
+                    do_not_optimize(it);
+                }
+            });
+        });
+    }
+    bench("erase_key", [&] {
+        return measure_fresh(options, n, filled_map, [&](std::unique_ptr<Map>& map) {
+            for (size_t i = 0; i < n; i++) {
+                map->erase(keys.hits[i]);
+            }
+        });
+    });
+    std::vector<std::pair<Key, int>> values(n);
+    for (size_t i = 0; i < n; i++) {
+        values[i] = std::make_pair(keys.misses[i], static_cast<int>(i));
+    }
+    std::sort(values.begin(), values.end());
+    std::vector<Key> sorted_hits(keys.hits.begin(), keys.hits.begin() + n);
+    std::sort(sorted_hits.begin(), sorted_hits.end());
+    bench("insert_many", [&] {
+        return measure_fresh(options, n, filled_map, [&](std::unique_ptr<Map>& map) {
+            for (size_t i = 0; i < n; i += batch_size) {
+                auto first = values.begin() + i;
+                auto last = values.begin() + std::min(n, i + batch_size);
+                if constexpr (has_batch_ops<Map>::value) {
+                    auto results = map->insert_many(first, last);
+                    do_not_optimize(results);
+                } else {
+                    for (; first != last; ++first) {
+                        auto result = map->insert(*first);
+                        do_not_optimize(result);
+                    }
+                }
+            }
+        });
+    });
+    bench("erase_many", [&] {
+        return measure_fresh(options, n, filled_map, [&](std::unique_ptr<Map>& map) {
+            for (size_t i = 0; i < n; i += batch_size) {
+                auto first = sorted_hits.begin() + i;
+                auto last = sorted_hits.begin() + std::min(n, i + batch_size);
+                if constexpr (has_batch_ops<Map>::value) {
+                    auto results = map->erase_many(first, last);
+                    do_not_optimize(results);
+                } else {
+                    for (; first != last; ++first) {
+                        auto result = map->erase(*first);
+                        do_not_optimize(result);
+                    }
+                }
+            }
+        });
+    });
+    bench("erase_iterator", [&] {
+        return measure_fresh(options, n, filled_map, [&](std::unique_ptr<Map>& map) {
+            auto it = map->begin();
+            while (it != map->end()) {
+                it = map->erase(it);
+            }
+        });
+    });
+    if constexpr (has_range_erase<Map>::value) {
+        // Erases the map in ten windows of consecutive keys.
+        bench("erase_range", [&] {
+            return measure_fresh(options, n, filled_map, [&](std::unique_ptr<Map>& map) {
+                size_t window = std::max<size_t>(n / 10, 1);
+                for (size_t i = 0; i < n; i += window) {
+                    auto last = i + window < n ? map->lower_bound(sorted_hits[i + window]) : map->end();
+                    map->erase(map->lower_bound(sorted_hits[i]), last);
+                }
+            });
+        });
+    }
+    bench("iterate", [&] {
+        auto map = filled_map();
+        return measure_repeat(options, n, [&] {
+            long long sum = 0;
+            for (auto& [key, value] : *map) {
+                sum += value;
+            }
+            do_not_optimize(sum);
+        });
+    });
+    bench("clear", [&] {
+        return measure_fresh(options, n, filled_map, [&](std::unique_ptr<Map>& map) {
+            map->clear();
+        });
+    });
+}
+
+// The subset of run_map_suite a persistent map supports: it has no mutable iterators to erase through.
+template <class Map, class Key>
+void run_persistent_suite(const bench_options& options, bench_report& report, const std::string& container,
+                          const std::string& key_name, const key_set<Key>& keys, size_t n) {
+    auto bench = [&](const std::string& name, auto&& measure) {
+        if (report.enabled(container, key_name, name)) {
+            report.add(container, key_name, name, n, measure());
+        }
+    };
+    auto filled_map = [&] {
+        return make_filled_map<Map>(keys, n);
+    };
+    bench("insert", [&] {
+        return measure_fresh(options, n, [] { return std::make_unique<Map>(); }, [&](std::unique_ptr<Map>& map) {
+            for (size_t i = 0; i < n; i++) {
+                map->insert(std::make_pair(keys.hits[i], static_cast<int>(i)));
+            }
+        });
+    });
+    bench("find_hit", [&] {
+        auto map = filled_map();
+        return measure_repeat(options, n, [&] {
+            for (size_t i = 0; i < n; i++) {
+                auto found = map->contains(keys.hits[i]);
+                do_not_optimize(found);
+            }
+        });
+    });
+    bench("erase_key", [&] {
+        return measure_fresh(options, n, filled_map, [&](std::unique_ptr<Map>& map) {
+            for (size_t i = 0; i < n; i++) {
+                map->erase(keys.hits[i]);
+            }
+        });
+    });
+    bench("iterate", [&] {
+        auto map = filled_map();
+        return measure_repeat(options, n, [&] {
+            long long sum = 0;
+            for (auto& [key, value] : *map) {
+                sum += value;
+            }
+            do_not_optimize(sum);
+        });
+    });
+}
+
+template <class Map, class Key>
+void run_stale_iterator_suite(const bench_options& options, bench_report& report, const std::string& container,
+                              const std::string& key_name, const key_set<Key>& keys, size_t n) {
+    using iterator = typename Map::iterator;
+    struct state {
+        std::unique_ptr<Map> map;
+        std::vector<iterator> its;
+    };
+    auto filled_state = [&] {
+        auto result = std::make_unique<state>();
+        result->map = make_filled_map<Map>(keys, n);
+        result->its.reserve(n);
+        for (size_t i = 0; i < n; i++) {
+            result->its.push_back(result->map->find(keys.hits[i]));
+        }
+        return result;
+    };
+    if (report.enabled(container, key_name, "erase_then_step")) {
+        report.add(container, key_name, "erase_then_step", n,
+                   measure_fresh(options, n, filled_state, [&](std::unique_ptr<state>& s) {
+                       for (size_t i = 0; i < n; i++) {
+                           s->map->erase(s->its[i]);
+                           ++s->its[i];
+                           do_not_optimize(s->its[i]);
+                       }
+                   }));
+    }
+    if (report.enabled(container, key_name, "erase_half_then_step")) {
+        report.add(container, key_name, "erase_half_then_step", n,
+                   measure_fresh(options, n, filled_state, [&](std::unique_ptr<state>& s) {
+                       for (size_t i = 0; i < n; i += 2) {
+                           s->map->erase(s->its[i]);
+                       }
+                       for (size_t i = 0; i < n; i += 2) {
+                           ++s->its[i];
+                           do_not_optimize(s->its[i]);
+                       }
+                   }));
+    }
+    if (report.enabled(container, key_name, "clear_then_step")) {
+        report.add(container, key_name, "clear_then_step", n,
+                   measure_fresh(options, n, filled_state, [&](std::unique_ptr<state>& s) {
+                       s->map->clear();
+                       for (size_t i = 0; i < n; i++) {
+                           --s->its[i];
+                           do_not_optimize(s->its[i]);
+                       }
+                   }));
+    }
+}
+
+// Compares taking a consistent view of a filled map, an O(1) snapshot followed by the write that has to
+// copy its path, against copying the whole map. ns/op is per view taken.
+template <class Map, class Key>
+void run_snapshot_suite(const bench_options& options, bench_report& report, const std::string& container,
+                        const std::string& key_name, const key_set<Key>& keys, size_t n) {
+    auto map = make_filled_map<Map>(keys, n);
+    if (report.enabled(container, key_name, "snapshot_and_write")) {
+        size_t reps = bench::repetitions(options, n);
+        bench::stopwatch watch;
+        watch.start();
+        for (size_t i = 0; i < reps; i++) {
+            if constexpr (std::is_same_v<Map, polyndrom::persistent_acid_map<Key, int>>) {
+                auto snapshot = map->snapshot();
+                map->insert_or_assign(keys.hits[i % n], static_cast<int>(i));
+                do_not_optimize(snapshot);
+            } else {
+                Map copy(map->begin(), map->end());
+                (*map)[keys.hits[i % n]] = static_cast<int>(i);
+                do_not_optimize(copy);
+            }
+        }
+        watch.stop();
+        report.add(container, key_name, "snapshot_and_write", n, watch.result(reps));
+    }
+    if constexpr (std::is_same_v<Map, polyndrom::persistent_acid_map<Key, int>>) {
+        if (report.enabled(container, key_name, "insert_under_snapshot")) {
+            report.add(container, key_name, "insert_under_snapshot", n,
+                       measure_fresh(options, n, [&] {
+                           auto state = std::make_pair(std::make_unique<Map>(), std::vector<typename Map::snapshot_type>());
+                           for (size_t i = 0; i < n; i++) {
+                               state.first->emplace(keys.hits[i], static_cast<int>(i));
+                           }
+                           state.second.push_back(state.first->snapshot());
+                           return state;
+                       }, [&](auto& state) {
+                           for (size_t i = 0; i < n; i++) {
+                               state.first->emplace(keys.misses[i], static_cast<int>(i));
+                           }
+                       }));
+        }
+    }
+}
+
+template <class Key, class Generator>
+void run_key_type(const bench_options& options, bench_report& report, const std::string& key_name,
+                  Generator generator) {
+    auto sizes = bench::bench_sizes(options);
+    if (sizes.empty()) {
+        return;
+    }
+    key_set<Key> keys = bench::make_key_set<Key>(sizes.back(), options.seed, generator);
+    for (size_t n : sizes) {
+        run_map_suite<polyndrom::acid_map<Key, int>>(options, report, "polyndrom::acid_map", key_name, keys, n);
+        run_map_suite<pooled_acid_map<Key, int>>(options, report, "acid_map+node_pool", key_name, keys, n);
+        run_map_suite<polyndrom::threaded_acid_map<Key, int>>(options, report, "threaded_acid_map", key_name, keys, n);
+        run_map_suite<polyndrom::acid_btree<Key, int>>(options, report, "acid_btree", key_name, keys, n);
+        run_map_suite<std::map<Key, int>>(options, report, "std::map", key_name, keys, n);
+        run_persistent_suite<polyndrom::persistent_acid_map<Key, int>>(options, report, "persistent_acid_map",
+                                                                        key_name, keys, n);
+        run_snapshot_suite<polyndrom::persistent_acid_map<Key, int>>(options, report, "persistent_acid_map",
+                                                                      key_name, keys, n);
+        run_snapshot_suite<polyndrom::acid_map<Key, int>>(options, report, "polyndrom::acid_map", key_name, keys, n);
+        if (n <= options.stale_max_size) {
+            run_stale_iterator_suite<polyndrom::acid_map<Key, int>>(options, report, "polyndrom::acid_map", key_name,
+                                                                     keys, n);
+            run_stale_iterator_suite<polyndrom::acid_btree<Key, int>>(options, report, "acid_btree", key_name, keys, n);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    bench_options options = bench::parse_options(argc, argv);
+    bench_report report(options);
+    run_key_type<int>(options, report, "int", int_generator(INT_MIN, INT_MAX, options.seed));
+    run_key_type<std::string>(options, report, "std::string", string_generator(8, 32, options.seed));
+    run_key_type<std::string>(options, report, "std::string(100)", string_generator(100, 100, options.seed));
+    run_key_type<complex_object>(options, report, "complex_object", complex_object_generator(options.seed));
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include "acid_map.hpp"
+#include "bench_utils.hpp"
+#include "paged_acid_map.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <filesystem>
+#include <unistd.h>
+
+using bench::bench_options;
+using bench::bench_report;
+using bench::key_set;
+
+using paged_map = polyndrom::paged_acid_map<int, int>;
+
+// Times every lookup on its own and reports the median, the 99th and the 99.9th percentile, so pools
+// smaller than the working set show how far the tail moves rather than only the mean.
+void report_latencies(bench_report& report, const std::string& container, const std::string& suffix, size_t n,
+                      std::vector<double>& latencies) {
+    std::sort(latencies.begin(), latencies.end());
+    auto at = [&](double quantile) {
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(quantile * latencies.size()))];
+    };
+    report.add(container, "int", "find_p50" + suffix, n, {at(0.5), 0});
+    report.add(container, "int", "find_p99" + suffix, n, {at(0.99), 0});
+    report.add(container, "int", "find_p999" + suffix, n, {at(0.999), 0});
+}
+
+template <class Map>
+std::vector<double> lookup_latencies(Map& map, const std::vector<int>& keys, size_t ops) {
+    std::vector<double> latencies;
+    latencies.reserve(ops);
+    for (size_t i = 0; i < ops; i++) {
+        auto start = std::chrono::steady_clock::now();
+        bool found = map.contains(keys[i % keys.size()]);
+        auto finish = std::chrono::steady_clock::now();
+        bench::do_not_optimize(found);
+        latencies.push_back(std::chrono::duration<double, std::nano>(finish - start).count());
+    }
+    return latencies;
+}
+
+// Builds the map once, then reopens the file with buffer pools holding all, a quarter and a twentieth of
+// its pages. Pages that leave the pool are read back through the operating system page cache, the rows
+// measure the pool and the tree, not the disk.
+int main(int argc, char** argv) {
+    bench_options options = bench::parse_options(argc, argv);
+    bench_report report(options);
+    auto sizes = bench::bench_sizes(options);
+    if (sizes.empty()) {
+        return 0;
+    }
+    std::string path =
+        (std::filesystem::temp_directory_path() / ("paged_bench_" + std::to_string(::getpid()))).string();
+    int_generator generator(INT_MIN, INT_MAX, options.seed);
+    key_set<int> keys = bench::make_key_set<int>(sizes.back(), options.seed, generator);
+    for (size_t n : sizes) {
+        std::vector<int> hits(keys.hits.begin(), keys.hits.begin() + n);
+        size_t ops = std::max(n, options.min_ops);
+        if (report.enabled("acid_map", "int", "find_p99")) {
+            polyndrom::acid_map<int, int> map;
+            for (size_t i = 0; i < n; i++) {
+                map.emplace(hits[i], static_cast<int>(i));
+            }
+            std::vector<double> latencies = lookup_latencies(map, hits, ops);
+            report_latencies(report, "acid_map", "", n, latencies);
+        }
+        std::filesystem::remove(path);
+        size_t pages;
+        {
+            paged_map map(path, 1 << 16);
+            bench::stopwatch watch;
+            watch.start();
+            for (size_t i = 0; i < n; i++) {
+                map.emplace(hits[i], static_cast<int>(i));
+            }
+            watch.stop();
+            if (report.enabled("paged_acid_map", "int", "insert/pool=all")) {
+                report.add("paged_acid_map", "int", "insert/pool=all", n, watch.result(n));
+            }
+            pages = map.pages().pages();
+        }
+        for (size_t percent : {100, 25, 5}) {
+            std::string suffix = "/pool=" + std::to_string(percent) + "%";
+            size_t pool_pages = std::max<size_t>(8, pages * percent / 100);
+            paged_map map(path, pool_pages);
+            if (report.enabled("paged_acid_map", "int", "find_hit" + suffix)) {
+                report.add("paged_acid_map", "int", "find_hit" + suffix, n, bench::measure_repeat(options, n, [&] {
+                    size_t found = 0;
+                    for (size_t i = 0; i < n; i++) {
+                        found += map.contains(hits[i]);
+                    }
+                    bench::do_not_optimize(found);
+                }));
+            }
+            if (report.enabled("paged_acid_map", "int", "find_p99" + suffix)) {
+                std::vector<double> latencies = lookup_latencies(map, hits, ops);
+                report_latencies(report, "paged_acid_map", suffix, n, latencies);
+            }
+            if (report.enabled("paged_acid_map", "int", "insert_miss" + suffix)) {
+                bench::stopwatch watch;
+                watch.start();
+                for (size_t i = 0; i < n; i++) {
+                    map.emplace(keys.misses[i], static_cast<int>(i));
+                }
+                watch.stop();
+                report.add("paged_acid_map", "int", "insert_miss" + suffix, n, watch.result(n));
+                for (size_t i = 0; i < n; i++) {
+                    map.erase(keys.misses[i]);
+                }
+            }
+        }
+    }
+    std::filesystem::remove(path);
+    return 0;
+}
@@ -0,0 +1,54 @@
+#include "bench_utils.hpp"
+#include "durable_acid_map.hpp"
+
+#include <filesystem>
+#include <thread>
+#include <unistd.h>
+
+using bench::bench_options;
+using bench::bench_report;
+
+// Writes through a durable_acid_map with every durability level and 1..N writer threads. ns/op is wall
+// time per write across all threads, so group commit shows up as ns/op falling with more writers.
+int main(int argc, char** argv) {
+    bench_options options = bench::parse_options(argc, argv);
+    bench_report report(options);
+    const std::pair<polyndrom::durability, std::string> levels[] = {
+        {polyndrom::durability::sync, "sync"},
+        {polyndrom::durability::group, "group"},
+        {polyndrom::durability::async, "async"},
+    };
+    size_t max_threads = std::max<size_t>(8, std::thread::hardware_concurrency());
+    size_t writes = std::max<size_t>(1, options.min_ops / 100);
+    std::string path = (std::filesystem::temp_directory_path() / ("wal_bench_" + std::to_string(::getpid()))).string();
+    for (auto& [level, level_name] : levels) {
+        for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+            std::string name = level_name + "/" + std::to_string(threads) + "t";
+            if (!report.enabled("durable_acid_map", "int", name)) {
+                continue;
+            }
+            std::filesystem::remove(path);
+            bench::stopwatch watch;
+            {
+                polyndrom::durable_acid_map<int, int> map(path, level);
+                std::vector<std::thread> workers;
+                size_t per_thread = std::max<size_t>(1, writes / threads);
+                watch.start();
+                for (size_t t = 0; t < threads; t++) {
+                    workers.emplace_back([&map, t, per_thread] {
+                        for (size_t i = 0; i < per_thread; i++) {
+                            map.insert_or_assign(static_cast<int>(t * per_thread + i), static_cast<int>(i));
+                        }
+                    });
+                }
+                for (std::thread& worker : workers) {
+                    worker.join();
+                }
+                watch.stop();
+            }
+            report.add("durable_acid_map", "int", name, writes, watch.result(writes));
+        }
+    }
+    std::filesystem::remove(path);
+    return 0;
+}
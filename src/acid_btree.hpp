@@ -0,0 +1,785 @@
+#pragma once
+
+#include "key_compare.hpp"
+#include "simd_search.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace polyndrom {
+
+// An ordered map kept in a B+ tree whose nodes hold dozens of keys, so a lookup touches a few wide
+// nodes instead of one node per level of a binary tree. Elements live in cells of their own, the
+// leaves hold a copy of every key next to a pointer to its cell, so keys have to be copy constructible.
+//
+// Iterators keep the guarantee of acid_map: they hold a reference to their cell, so an iterator to an
+// erased element still dereferences to it and ++ and -- move to the elements that follow and precede
+// its key. An iterator remembers its leaf and slot and walks the leaves while the tree is unchanged,
+// after a modification its first step finds the key again from the root.
+template <class Key, class T, class Compare = std::less<Key>, class Allocator = std::allocator<std::pair<const Key, T>>>
+class acid_btree {
+public:
+    using key_type = Key;
+    using mapped_type = T;
+    using value_type = std::pair<const Key, T>;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using key_compare = Compare;
+    using allocator_type = Allocator;
+    using reference = value_type&;
+    using const_reference = const value_type&;
+private:
+    using self_type = acid_btree<Key, T, Compare, Allocator>;
+    // Nodes are sized to about 512 bytes, between 8 and 64 keys.
+    static constexpr size_t node_bytes = 512;
+    static constexpr size_t leaf_capacity = std::clamp<size_t>(node_bytes / (sizeof(Key) + sizeof(void*)), 8, 64);
+    static constexpr size_t inner_capacity = std::clamp<size_t>(node_bytes / (sizeof(Key) + sizeof(void*)), 8, 64);
+    // Integer keys in the default order are searched with vector compares instead of a binary search.
+    template <class K>
+    static constexpr bool uses_simd_search =
+        is_simd_searchable<Key>::value && is_default_less<Key, Compare>::value && std::is_same_v<K, Key>;
+
+    struct cell {
+        template <class... Args>
+        cell(Args&&... args) : value(std::forward<Args>(args)...) {}
+        value_type value;
+        // Live cells are owned by the tree, refs only counts iterators.
+        uint32_t refs = 0;
+        bool is_erased = false;
+    };
+    template <size_t N>
+    struct key_array {
+        Key* data() {
+            return std::launder(reinterpret_cast<Key*>(bytes));
+        }
+        const Key* data() const {
+            return std::launder(reinterpret_cast<const Key*>(bytes));
+        }
+        alignas(Key) unsigned char bytes[N * sizeof(Key)];
+    };
+    struct node {
+        explicit node(bool is_leaf) : is_leaf(is_leaf) {}
+        uint16_t count = 0;
+        bool is_leaf;
+    };
+    struct leaf_node : node {
+        leaf_node() : node(true) {}
+        key_array<leaf_capacity> keys;
+        cell* cells[leaf_capacity];
+        leaf_node* prev = nullptr;
+        leaf_node* next = nullptr;
+    };
+    // Child i holds the keys below separator i, child i + 1 the keys from separator i on.
+    struct inner_node : node {
+        inner_node() : node(false) {}
+        key_array<inner_capacity> keys;
+        node* children[inner_capacity + 1];
+    };
+    using alloc_traits = std::allocator_traits<Allocator>;
+    using cell_allocator_type = typename alloc_traits::template rebind_alloc<cell>;
+    using leaf_allocator_type = typename alloc_traits::template rebind_alloc<leaf_node>;
+    using inner_allocator_type = typename alloc_traits::template rebind_alloc<inner_node>;
+    struct split_result {
+        Key separator;
+        node* right;
+    };
+    struct position {
+        leaf_node* leaf = nullptr;
+        size_t slot = 0;
+    };
+public:
+    class iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = typename self_type::value_type;
+        using pointer = value_type*;
+        using reference = value_type&;
+        iterator() = default;
+        iterator(const iterator& other)
+            : tree(other.tree), current(other.current), at(other.at), version(other.version) {
+            acquire();
+        }
+        iterator& operator=(const iterator& other) {
+            if (current != other.current) {
+                release();
+                current = other.current;
+                acquire();
+            }
+            tree = other.tree;
+            at = other.at;
+            version = other.version;
+            return *this;
+        }
+        ~iterator() {
+            release();
+        }
+        iterator& operator++() {
+            // Like acid_map's end(), end() stays past the last element.
+            if (current == nullptr) {
+                return *this;
+            }
+            position next;
+            if (version == tree->version) {
+                next = tree->step_forward(at);
+            } else {
+                next = tree->seek_upper(current->value.first);
+            }
+            move_to(next);
+            return *this;
+        }
+        iterator operator++(int) {
+            iterator other(*this);
+            ++*this;
+            return other;
+        }
+        iterator& operator--() {
+            position prev;
+            if (current == nullptr) {
+                prev = tree->last();
+            } else if (version == tree->version) {
+                prev = tree->step_backward(at);
+            } else {
+                prev = tree->seek_lower(current->value.first);
+                prev = prev.leaf == nullptr ? tree->last() : tree->step_backward(prev);
+            }
+            move_to(prev);
+            return *this;
+        }
+        iterator operator--(int) {
+            iterator other(*this);
+            --*this;
+            return other;
+        }
+        value_type& operator*() const {
+            return current->value;
+        }
+        value_type* operator->() const {
+            return &current->value;
+        }
+        bool operator==(const iterator& other) const {
+            return current == other.current;
+        }
+        bool operator!=(const iterator& other) const {
+            return current != other.current;
+        }
+    private:
+        friend class acid_btree;
+        iterator(const acid_btree* tree, position at) : tree(tree) {
+            move_to(at);
+        }
+        void move_to(position next) {
+            cell* target = next.leaf == nullptr ? nullptr : next.leaf->cells[next.slot];
+            if (target != current) {
+                release();
+                current = target;
+                acquire();
+            }
+            at = next;
+            version = tree->version;
+        }
+        void acquire() {
+            if (current != nullptr) {
+                ++current->refs;
+            }
+        }
+        void release() {
+            if (current != nullptr) {
+                const_cast<acid_btree*>(tree)->release_cell(current);
+                current = nullptr;
+            }
+        }
+        const acid_btree* tree = nullptr;
+        cell* current = nullptr;
+        position at;
+        uint64_t version = 0;
+    };
+
+    acid_btree(const allocator_type& allocator = allocator_type())
+        : cell_allocator(allocator), leaf_allocator(allocator), inner_allocator(allocator) {}
+    explicit acid_btree(const key_compare& comparator, const allocator_type& allocator = allocator_type())
+        : comparator(comparator), cell_allocator(allocator), leaf_allocator(allocator), inner_allocator(allocator) {}
+    template <class InputIt>
+    acid_btree(InputIt first, InputIt last, const allocator_type& allocator = allocator_type())
+        : acid_btree(allocator) {
+        for (; first != last; ++first) {
+            emplace(*first);
+        }
+    }
+    acid_btree(const acid_btree&) = delete;
+    acid_btree& operator=(const acid_btree&) = delete;
+    ~acid_btree() {
+        dispose(root);
+    }
+    template <class K>
+    iterator find(const K& key) const {
+        position at = seek_lower(key);
+        if (at.leaf == nullptr || comparator(key, at.leaf->keys.data()[at.slot])) {
+            return end();
+        }
+        return iterator(this, at);
+    }
+    template <class K>
+    iterator lower_bound(const K& key) const {
+        return iterator(this, seek_lower(key));
+    }
+    template <class K>
+    iterator upper_bound(const K& key) const {
+        return iterator(this, seek_upper(key));
+    }
+    template <class K>
+    bool contains(const K& key) const {
+        position at = seek_lower(key);
+        return at.leaf != nullptr && !comparator(key, at.leaf->keys.data()[at.slot]);
+    }
+    template <class K>
+    size_type count(const K& key) const {
+        return contains(key) ? 1 : 0;
+    }
+    mapped_type& at(const key_type& key) {
+        iterator it = find(key);
+        if (it == end()) {
+            throw std::out_of_range("Key does not exists");
+        }
+        return it->second;
+    }
+    template <class K>
+    mapped_type& operator[](K&& key) {
+        return try_emplace(std::forward<K>(key)).first->second;
+    }
+    std::pair<iterator, bool> insert(const value_type& value) {
+        return insert_cell(value.first, [&] {
+            return create_cell(value);
+        });
+    }
+    template <class InputIt>
+    void insert(InputIt first, InputIt last) {
+        for (; first != last; ++first) {
+            emplace(*first);
+        }
+    }
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        value_type value(std::forward<Args>(args)...);
+        return insert_cell(value.first, [&] {
+            return create_cell(std::move(value));
+        });
+    }
+    template <class K, class... Args>
+    std::pair<iterator, bool> try_emplace(K&& key, Args&&... args) {
+        return insert_cell(key, [&] {
+            return create_cell(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                               std::forward_as_tuple(std::forward<Args>(args)...));
+        });
+    }
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(const key_type& key, M&& mapped) {
+        auto result = insert_cell(key, [&] {
+            return create_cell(key, std::forward<M>(mapped));
+        });
+        if (!result.second) {
+            result.first->second = std::forward<M>(mapped);
+        }
+        return result;
+    }
+    template <class K>
+    size_type erase(const K& key) {
+        if (root == nullptr) {
+            return 0;
+        }
+        cell* removed = nullptr;
+        erase_at(root, key, removed);
+        if (removed == nullptr) {
+            return 0;
+        }
+        if (root->count == 0) {
+            node* old = root;
+            root = root->is_leaf ? nullptr : static_cast<inner_node*>(old)->children[0];
+            destroy_node(old);
+        }
+        --tree_size;
+        ++version;
+        retire_cell(removed);
+        return 1;
+    }
+    // Returns the iterator following the erased element. An iterator to an element erased before only steps
+    // on, an element inserted since with the same key stays.
+    iterator erase(iterator it) {
+        if (!it.current->is_erased) {
+            erase(it->first);
+        }
+        return ++it;
+    }
+    iterator begin() const {
+        if (root == nullptr) {
+            return end();
+        }
+        node* current = root;
+        while (!current->is_leaf) {
+            current = static_cast<inner_node*>(current)->children[0];
+        }
+        return iterator(this, position{static_cast<leaf_node*>(current), 0});
+    }
+    iterator end() const {
+        return iterator(this, position{});
+    }
+    key_compare key_comp() const {
+        return comparator;
+    }
+    size_type size() const {
+        return tree_size;
+    }
+    bool empty() const {
+        return tree_size == 0;
+    }
+    void clear() {
+        dispose(root);
+        root = nullptr;
+        tree_size = 0;
+        ++version;
+    }
+private:
+    template <class... Args>
+    cell* create_cell(Args&&... args) {
+        cell* created = std::allocator_traits<cell_allocator_type>::allocate(cell_allocator, 1);
+        try {
+            std::allocator_traits<cell_allocator_type>::construct(cell_allocator, created, std::forward<Args>(args)...);
+        } catch (...) {
+            std::allocator_traits<cell_allocator_type>::deallocate(cell_allocator, created, 1);
+            throw;
+        }
+        return created;
+    }
+    void destroy_cell(cell* target) {
+        std::allocator_traits<cell_allocator_type>::destroy(cell_allocator, target);
+        std::allocator_traits<cell_allocator_type>::deallocate(cell_allocator, target, 1);
+    }
+    // Hands an erased cell to the iterators still referring to it, the last one destroys it.
+    void retire_cell(cell* target) {
+        target->is_erased = true;
+        if (target->refs == 0) {
+            destroy_cell(target);
+        }
+    }
+    // GCC 12 cannot tell that another iterator still holds a reference when two releases of the same
+    // cell are inlined next to each other.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuse-after-free"
+#endif
+    void release_cell(cell* target) {
+        target->refs -= 1;
+        if (target->refs == 0 && target->is_erased) {
+            destroy_cell(target);
+        }
+    }
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+#pragma GCC diagnostic pop
+#endif
+    leaf_node* create_leaf() {
+        leaf_node* created = std::allocator_traits<leaf_allocator_type>::allocate(leaf_allocator, 1);
+        return ::new (static_cast<void*>(created)) leaf_node();
+    }
+    inner_node* create_inner() {
+        inner_node* created = std::allocator_traits<inner_allocator_type>::allocate(inner_allocator, 1);
+        return ::new (static_cast<void*>(created)) inner_node();
+    }
+    void destroy_node(node* target) {
+        if (target->is_leaf) {
+            auto* leaf = static_cast<leaf_node*>(target);
+            std::destroy_n(leaf->keys.data(), leaf->count);
+            leaf->~leaf_node();
+            std::allocator_traits<leaf_allocator_type>::deallocate(leaf_allocator, leaf, 1);
+        } else {
+            auto* inner = static_cast<inner_node*>(target);
+            std::destroy_n(inner->keys.data(), inner->count);
+            inner->~inner_node();
+            std::allocator_traits<inner_allocator_type>::deallocate(inner_allocator, inner, 1);
+        }
+    }
+    void dispose(node* target) {
+        if (target == nullptr) {
+            return;
+        }
+        if (target->is_leaf) {
+            auto* leaf = static_cast<leaf_node*>(target);
+            for (size_t i = 0; i < leaf->count; i++) {
+                retire_cell(leaf->cells[i]);
+            }
+        } else {
+            auto* inner = static_cast<inner_node*>(target);
+            for (size_t i = 0; i <= inner->count; i++) {
+                dispose(inner->children[i]);
+            }
+        }
+        destroy_node(target);
+    }
+
+    // Key array helpers, slots past count hold no object.
+    static void insert_key(Key* keys, size_t count, size_t pos, const Key& key) {
+        if (pos == count) {
+            ::new (static_cast<void*>(keys + count)) Key(key);
+            return;
+        }
+        ::new (static_cast<void*>(keys + count)) Key(std::move(keys[count - 1]));
+        std::move_backward(keys + pos, keys + count - 1, keys + count);
+        keys[pos] = key;
+    }
+    static void erase_key(Key* keys, size_t count, size_t pos) {
+        std::move(keys + pos + 1, keys + count, keys + pos);
+        keys[count - 1].~Key();
+    }
+    // Moves keys into uninitialized slots and ends the lifetime of the sources.
+    static void relocate_keys(Key* from, size_t count, Key* to) {
+        std::uninitialized_move_n(from, count, to);
+        std::destroy_n(from, count);
+    }
+    template <class K>
+    size_t lower_index(const Key* keys, size_t count, const K& key) const {
+        if constexpr (uses_simd_search<K>) {
+            return simd_rank<false>(keys, count, key);
+        } else {
+            return std::lower_bound(keys, keys + count, key, comparator) - keys;
+        }
+    }
+    template <class K>
+    size_t child_index(const inner_node* inner, const K& key) const {
+        const Key* keys = inner->keys.data();
+        if constexpr (uses_simd_search<K>) {
+            return simd_rank<true>(keys, inner->count, key);
+        } else {
+            return std::upper_bound(keys, keys + inner->count, key, comparator) - keys;
+        }
+    }
+    template <class K>
+    leaf_node* find_leaf(const K& key) const {
+        node* current = root;
+        while (!current->is_leaf) {
+            auto* inner = static_cast<inner_node*>(current);
+            current = inner->children[child_index(inner, key)];
+        }
+        return static_cast<leaf_node*>(current);
+    }
+    position normalize(position at) const {
+        if (at.leaf != nullptr && at.slot == at.leaf->count) {
+            return position{at.leaf->next, 0};
+        }
+        return at;
+    }
+    template <class K>
+    position seek_lower(const K& key) const {
+        if (root == nullptr) {
+            return position{};
+        }
+        leaf_node* leaf = find_leaf(key);
+        return normalize(position{leaf, lower_index(leaf->keys.data(), leaf->count, key)});
+    }
+    template <class K>
+    position seek_upper(const K& key) const {
+        if (root == nullptr) {
+            return position{};
+        }
+        leaf_node* leaf = find_leaf(key);
+        const Key* keys = leaf->keys.data();
+        size_t slot = std::upper_bound(keys, keys + leaf->count, key, comparator) - keys;
+        return normalize(position{leaf, slot});
+    }
+    position step_forward(position at) const {
+        return normalize(position{at.leaf, at.slot + 1});
+    }
+    position step_backward(position at) const {
+        if (at.slot > 0) {
+            return position{at.leaf, at.slot - 1};
+        }
+        leaf_node* prev = at.leaf->prev;
+        return prev == nullptr ? position{} : position{prev, prev->count - size_t(1)};
+    }
+    position last() const {
+        if (root == nullptr) {
+            return position{};
+        }
+        node* current = root;
+        while (!current->is_leaf) {
+            auto* inner = static_cast<inner_node*>(current);
+            current = inner->children[inner->count];
+        }
+        auto* leaf = static_cast<leaf_node*>(current);
+        return position{leaf, leaf->count - size_t(1)};
+    }
+
+    template <class Make>
+    std::pair<iterator, bool> insert_cell(const Key& key, Make make) {
+        auto [at, inserted] = place(key, make);
+        return {iterator(this, at), inserted};
+    }
+    // Finds the slot of key, calling make for the cell to insert when the key is missing.
+    template <class Make>
+    std::pair<position, bool> place(const Key& key, Make make) {
+        if (root == nullptr) {
+            root = create_leaf();
+        }
+        position at;
+        bool inserted = false;
+        std::vector<inner_node*> spares;
+        std::optional<split_result> split;
+        try {
+            split = insert_at(root, key, make, at, inserted, 1, spares);
+        } catch (...) {
+            if (tree_size == 0) {
+                destroy_node(root);
+                root = nullptr;
+            }
+            throw;
+        }
+        if (split) {
+            inner_node* grown = spares.back();
+            spares.pop_back();
+            ::new (static_cast<void*>(grown->keys.data())) Key(std::move(split->separator));
+            grown->children[0] = root;
+            grown->children[1] = split->right;
+            grown->count = 1;
+            root = grown;
+        }
+        if (inserted) {
+            ++tree_size;
+            ++version;
+        }
+        return {at, inserted};
+    }
+    // A split of target takes needed inner nodes from spares: the new right siblings of its full ancestors
+    // and a new root if they reach it. The leaf that splits allocates them before changing anything, so a
+    // failed allocation leaves the tree as it was.
+    template <class Make>
+    std::optional<split_result> insert_at(node* target, const Key& key, Make& make, position& at, bool& inserted,
+                                          size_t needed, std::vector<inner_node*>& spares) {
+        if (target->is_leaf) {
+            return insert_into_leaf(static_cast<leaf_node*>(target), key, make, at, inserted, needed, spares);
+        }
+        auto* inner = static_cast<inner_node*>(target);
+        size_t index = child_index(inner, key);
+        size_t child_needed = inner->count < inner_capacity ? 0 : needed + 1;
+        std::optional<split_result> split =
+            insert_at(inner->children[index], key, make, at, inserted, child_needed, spares);
+        if (!split) {
+            return std::nullopt;
+        }
+        if (inner->count < inner_capacity) {
+            insert_into_inner(inner, index, *split);
+            return std::nullopt;
+        }
+        inner_node* right = spares.back();
+        spares.pop_back();
+        Key* keys = inner->keys.data();
+        size_t mid = inner->count / 2;
+        size_t moved = inner->count - mid - 1;
+        split_result promoted{std::move(keys[mid]), right};
+        relocate_keys(keys + mid + 1, moved, right->keys.data());
+        std::copy_n(inner->children + mid + 1, moved + 1, right->children);
+        keys[mid].~Key();
+        right->count = static_cast<uint16_t>(moved);
+        inner->count = static_cast<uint16_t>(mid);
+        if (index <= mid) {
+            insert_into_inner(inner, index, *split);
+        } else {
+            insert_into_inner(right, index - mid - 1, *split);
+        }
+        return promoted;
+    }
+    void insert_into_inner(inner_node* inner, size_t index, split_result& split) {
+        insert_key(inner->keys.data(), inner->count, index, split.separator);
+        std::copy_backward(inner->children + index + 1, inner->children + inner->count + 1,
+                           inner->children + inner->count + 2);
+        inner->children[index + 1] = split.right;
+        ++inner->count;
+    }
+    template <class Make>
+    std::optional<split_result> insert_into_leaf(leaf_node* leaf, const Key& key, Make& make, position& at,
+                                                 bool& inserted, size_t needed, std::vector<inner_node*>& spares) {
+        size_t pos = lower_index(leaf->keys.data(), leaf->count, key);
+        if (pos < leaf->count && !comparator(key, leaf->keys.data()[pos])) {
+            at = position{leaf, pos};
+            return std::nullopt;
+        }
+        if (leaf->count < leaf_capacity) {
+            insert_into_leaf(leaf, pos, make());
+            at = position{leaf, pos};
+            inserted = true;
+            return std::nullopt;
+        }
+        leaf_node* right = create_leaf();
+        cell* created;
+        try {
+            spares.reserve(needed);
+            while (spares.size() < needed) {
+                spares.push_back(create_inner());
+            }
+            created = make();
+        } catch (...) {
+            for (inner_node* spare : spares) {
+                destroy_node(spare);
+            }
+            spares.clear();
+            destroy_node(right);
+            throw;
+        }
+        size_t mid = leaf->count / 2;
+        size_t moved = leaf->count - mid;
+        relocate_keys(leaf->keys.data() + mid, moved, right->keys.data());
+        std::copy_n(leaf->cells + mid, moved, right->cells);
+        right->count = static_cast<uint16_t>(moved);
+        leaf->count = static_cast<uint16_t>(mid);
+        right->next = leaf->next;
+        right->prev = leaf;
+        if (leaf->next != nullptr) {
+            leaf->next->prev = right;
+        }
+        leaf->next = right;
+        if (pos <= mid) {
+            insert_into_leaf(leaf, pos, created);
+            at = position{leaf, pos};
+        } else {
+            insert_into_leaf(right, pos - mid, created);
+            at = position{right, pos - mid};
+        }
+        inserted = true;
+        return split_result{right->keys.data()[0], right};
+    }
+    void insert_into_leaf(leaf_node* leaf, size_t pos, cell* created) {
+        insert_key(leaf->keys.data(), leaf->count, pos, created->value.first);
+        std::copy_backward(leaf->cells + pos, leaf->cells + leaf->count, leaf->cells + leaf->count + 1);
+        leaf->cells[pos] = created;
+        ++leaf->count;
+    }
+
+    // Removes key below target and rebalances the children on the way back up, returns whether target
+    // fell under half full.
+    template <class K>
+    bool erase_at(node* target, const K& key, cell*& removed) {
+        if (target->is_leaf) {
+            auto* leaf = static_cast<leaf_node*>(target);
+            size_t pos = lower_index(leaf->keys.data(), leaf->count, key);
+            if (pos == leaf->count || comparator(key, leaf->keys.data()[pos])) {
+                return false;
+            }
+            removed = leaf->cells[pos];
+            erase_key(leaf->keys.data(), leaf->count, pos);
+            std::copy(leaf->cells + pos + 1, leaf->cells + leaf->count, leaf->cells + pos);
+            --leaf->count;
+            return leaf->count < leaf_capacity / 2;
+        }
+        auto* inner = static_cast<inner_node*>(target);
+        size_t index = child_index(inner, key);
+        if (erase_at(inner->children[index], key, removed)) {
+            fix_child(inner, index);
+        }
+        return inner->count < inner_capacity / 2;
+    }
+    void fix_child(inner_node* parent, size_t index) {
+        node* child = parent->children[index];
+        node* left = index > 0 ? parent->children[index - 1] : nullptr;
+        node* right = index < parent->count ? parent->children[index + 1] : nullptr;
+        size_t min_count = child->is_leaf ? leaf_capacity / 2 : inner_capacity / 2;
+        if (left != nullptr && left->count > min_count) {
+            borrow_from_left(parent, index);
+        } else if (right != nullptr && right->count > min_count) {
+            borrow_from_right(parent, index);
+        } else if (left != nullptr) {
+            merge(parent, index - 1);
+        } else if (right != nullptr) {
+            merge(parent, index);
+        }
+    }
+    void borrow_from_left(inner_node* parent, size_t index) {
+        Key& separator = parent->keys.data()[index - 1];
+        if (parent->children[index]->is_leaf) {
+            auto* child = static_cast<leaf_node*>(parent->children[index]);
+            auto* left = static_cast<leaf_node*>(parent->children[index - 1]);
+            insert_into_leaf(child, 0, left->cells[left->count - 1]);
+            erase_key(left->keys.data(), left->count, left->count - 1);
+            --left->count;
+            separator = child->keys.data()[0];
+        } else {
+            auto* child = static_cast<inner_node*>(parent->children[index]);
+            auto* left = static_cast<inner_node*>(parent->children[index - 1]);
+            insert_key(child->keys.data(), child->count, 0, separator);
+            std::copy_backward(child->children, child->children + child->count + 1, child->children + child->count + 2);
+            child->children[0] = left->children[left->count];
+            ++child->count;
+            separator = std::move(left->keys.data()[left->count - 1]);
+            left->keys.data()[left->count - 1].~Key();
+            --left->count;
+        }
+    }
+    void borrow_from_right(inner_node* parent, size_t index) {
+        Key& separator = parent->keys.data()[index];
+        if (parent->children[index]->is_leaf) {
+            auto* child = static_cast<leaf_node*>(parent->children[index]);
+            auto* right = static_cast<leaf_node*>(parent->children[index + 1]);
+            insert_into_leaf(child, child->count, right->cells[0]);
+            erase_key(right->keys.data(), right->count, 0);
+            std::copy(right->cells + 1, right->cells + right->count, right->cells);
+            --right->count;
+            separator = right->keys.data()[0];
+        } else {
+            auto* child = static_cast<inner_node*>(parent->children[index]);
+            auto* right = static_cast<inner_node*>(parent->children[index + 1]);
+            insert_key(child->keys.data(), child->count, child->count, separator);
+            child->children[child->count + 1] = right->children[0];
+            ++child->count;
+            separator = right->keys.data()[0];
+            erase_key(right->keys.data(), right->count, 0);
+            std::copy(right->children + 1, right->children + right->count + 1, right->children);
+            --right->count;
+        }
+    }
+    // Moves child index + 1 and separator index of parent into child index and frees the emptied node.
+    void merge(inner_node* parent, size_t index) {
+        node* left_node = parent->children[index];
+        node* right_node = parent->children[index + 1];
+        Key* separators = parent->keys.data();
+        if (left_node->is_leaf) {
+            auto* left = static_cast<leaf_node*>(left_node);
+            auto* right = static_cast<leaf_node*>(right_node);
+            relocate_keys(right->keys.data(), right->count, left->keys.data() + left->count);
+            std::copy_n(right->cells, right->count, left->cells + left->count);
+            left->count += right->count;
+            right->count = 0;
+            left->next = right->next;
+            if (right->next != nullptr) {
+                right->next->prev = left;
+            }
+        } else {
+            auto* left = static_cast<inner_node*>(left_node);
+            auto* right = static_cast<inner_node*>(right_node);
+            ::new (static_cast<void*>(left->keys.data() + left->count)) Key(std::move(separators[index]));
+            relocate_keys(right->keys.data(), right->count, left->keys.data() + left->count + 1);
+            std::copy_n(right->children, right->count + 1, left->children + left->count + 1);
+            left->count += right->count + 1;
+            right->count = 0;
+        }
+        erase_key(separators, parent->count, index);
+        std::copy(parent->children + index + 2, parent->children + parent->count + 1, parent->children + index + 1);
+        --parent->count;
+        destroy_node(right_node);
+    }
+
+    key_compare comparator;
+    cell_allocator_type cell_allocator;
+    leaf_allocator_type leaf_allocator;
+    inner_allocator_type inner_allocator;
+    node* root = nullptr;
+    size_type tree_size = 0;
+    uint64_t version = 0;
+};
+
+} // polyndrom
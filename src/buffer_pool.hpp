@@ -0,0 +1,262 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace polyndrom {
+
+// A fixed number of in memory frames caching the pages of one file. Pages are pinned while in use and
+// replaced with the CLOCK algorithm: the hand skips pinned frames and gives recently used ones a second
+// chance. Dirty pages are written back when they are replaced and on flush. Not thread safe.
+class buffer_pool {
+public:
+    using page_id = uint64_t;
+
+    struct statistics {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t writes = 0;
+    };
+
+    // A pinned page, the frame stays in memory until the handle is gone.
+    class page {
+    public:
+        page() = default;
+        page(const page&) = delete;
+        page& operator=(const page&) = delete;
+        page(page&& other) noexcept : pool(other.pool), frame(other.frame) {
+            other.pool = nullptr;
+        }
+        page& operator=(page&& other) noexcept {
+            if (this != &other) {
+                release();
+                pool = other.pool;
+                frame = other.frame;
+                other.pool = nullptr;
+            }
+            return *this;
+        }
+        ~page() {
+            release();
+        }
+        page_id id() const {
+            return pool->frames[frame].id;
+        }
+        const char* data() const {
+            return pool->frame_data(frame);
+        }
+        // Marks the page dirty, call before changing it.
+        char* mutable_data() {
+            pool->frames[frame].dirty = true;
+            return pool->frame_data(frame);
+        }
+    private:
+        friend class buffer_pool;
+        page(buffer_pool* pool, size_t frame) : pool(pool), frame(frame) {}
+        void release() {
+            if (pool != nullptr) {
+                --pool->frames[frame].pins;
+                pool = nullptr;
+            }
+        }
+        buffer_pool* pool = nullptr;
+        size_t frame = 0;
+    };
+
+    buffer_pool(const std::string& path, size_t page_size, size_t capacity)
+        : page_size(page_size), frames(capacity), memory(nullptr, &std::free) {
+        if (capacity == 0 || page_size == 0 || (page_size & (page_size - 1)) != 0) {
+            throw std::invalid_argument("Buffer pool needs at least one frame of a power of two size");
+        }
+        memory.reset(static_cast<char*>(std::aligned_alloc(page_size, page_size * capacity)));
+        if (memory == nullptr) {
+            throw std::bad_alloc();
+        }
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "Cannot open " + path);
+        }
+        struct stat status{};
+        if (::fstat(fd, &status) != 0) {
+            int code = errno;
+            ::close(fd);
+            throw std::system_error(code, std::generic_category(), "Cannot open " + path);
+        }
+        page_count = (static_cast<size_t>(status.st_size) + page_size - 1) / page_size;
+        table.reserve(capacity);
+    }
+    buffer_pool(const buffer_pool&) = delete;
+    buffer_pool& operator=(const buffer_pool&) = delete;
+    ~buffer_pool() {
+        try {
+            flush();
+        } catch (...) {
+        }
+        ::close(fd);
+    }
+    page pin(page_id id) {
+        auto found = table.find(id);
+        if (found != table.end()) {
+            ++stats.hits;
+            frame_info& info = frames[found->second];
+            ++info.pins;
+            info.referenced = true;
+            return page(this, found->second);
+        }
+        ++stats.misses;
+        size_t frame = take_frame();
+        read_page(id, frame_data(frame));
+        install(frame, id);
+        return page(this, frame);
+    }
+    // Appends a zeroed page to the file.
+    page allocate() {
+        size_t frame = take_frame();
+        std::memset(frame_data(frame), 0, page_size);
+        install(frame, page_count++);
+        frames[frame].dirty = true;
+        return page(this, frame);
+    }
+    // Writes every dirty page back and syncs the file.
+    void flush() {
+        for (size_t frame = 0; frame < frames.size(); frame++) {
+            write_back(frame);
+        }
+        if (::fdatasync(fd) != 0) {
+            throw std::system_error(errno, std::generic_category(), "Cannot sync pages");
+        }
+    }
+    // Forgets every page and truncates the file, no page may be pinned.
+    void reset() {
+        for (frame_info& info : frames) {
+            info = frame_info();
+        }
+        table.clear();
+        spare = {};
+        page_count = 0;
+        if (::ftruncate(fd, 0) != 0) {
+            throw std::system_error(errno, std::generic_category(), "Cannot truncate pages");
+        }
+    }
+    size_t pages() const {
+        return page_count;
+    }
+    size_t capacity() const {
+        return frames.size();
+    }
+    size_t page_bytes() const {
+        return page_size;
+    }
+    statistics counters() const {
+        return stats;
+    }
+private:
+    static constexpr page_id no_page = ~page_id(0);
+    struct frame_info {
+        page_id id = no_page;
+        unsigned pins = 0;
+        bool referenced = false;
+        bool dirty = false;
+    };
+    char* frame_data(size_t frame) const {
+        return memory.get() + frame * page_size;
+    }
+    size_t take_frame() {
+        for (size_t step = 0; step < 2 * frames.size() + 1; step++) {
+            size_t frame = hand;
+            hand = (hand + 1) % frames.size();
+            frame_info& info = frames[frame];
+            if (info.pins != 0) {
+                continue;
+            }
+            if (info.referenced) {
+                info.referenced = false;
+                continue;
+            }
+            write_back(frame);
+            if (info.id != no_page) {
+                spare = table.extract(info.id);
+                info.id = no_page;
+            }
+            return frame;
+        }
+        throw std::runtime_error("Every buffer pool frame is pinned");
+    }
+    void install(size_t frame, page_id id) {
+        frame_info& info = frames[frame];
+        info.id = id;
+        info.pins = 1;
+        info.referenced = true;
+        info.dirty = false;
+        if (spare) {
+            spare.key() = id;
+            spare.mapped() = frame;
+            table.insert(std::move(spare));
+        } else {
+            table.emplace(id, frame);
+        }
+    }
+    void write_back(size_t frame) {
+        frame_info& info = frames[frame];
+        if (!info.dirty) {
+            return;
+        }
+        const char* data = frame_data(frame);
+        size_t written = 0;
+        while (written < page_size) {
+            ssize_t count = ::pwrite(fd, data + written, page_size - written,
+                                     static_cast<off_t>(info.id * page_size + written));
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "Cannot write page");
+            }
+            written += static_cast<size_t>(count);
+        }
+        info.dirty = false;
+        ++stats.writes;
+    }
+    void read_page(page_id id, char* data) {
+        size_t done = 0;
+        while (done < page_size) {
+            ssize_t count = ::pread(fd, data + done, page_size - done, static_cast<off_t>(id * page_size + done));
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "Cannot read page");
+            }
+            if (count == 0) {
+                std::memset(data + done, 0, page_size - done);
+                break;
+            }
+            done += static_cast<size_t>(count);
+        }
+    }
+    size_t page_size;
+    std::vector<frame_info> frames;
+    std::unique_ptr<char, decltype(&std::free)> memory;
+    std::unordered_map<page_id, size_t> table;
+    // The table entry of the last replaced page, reused for the next one.
+    std::unordered_map<page_id, size_t>::node_type spare;
+    size_t hand = 0;
+    size_t page_count = 0;
+    statistics stats;
+    int fd = -1;
+};
+
+} // polyndrom
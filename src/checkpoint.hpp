@@ -0,0 +1,469 @@
+#pragma once
+
+#include "acid_map.hpp"
+#include "write_ahead_log.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace polyndrom {
+
+// Checkpoint file layout, all integers in host byte order:
+//   page 0      header: magic, format version, page size, element count, page count, index offset and
+//               size, key and mapped sizes of trivially copyable types (0 otherwise), index CRC32 and
+//               header CRC32
+//   pages 1..n  sorted records: CRC32 of the rest of the page, record count, record offsets, then the
+//               records as wal_codec encoded key and mapped value
+//   index       offset of the first key of every page among the keys that follow, then those keys
+// Pages are filled in key order, so a lookup is a binary search over the index followed by one over a
+// single page.
+namespace checkpoint_format {
+
+inline constexpr char magic[8] = {'A', 'C', 'I', 'D', 'C', 'K', 'P', 'T'};
+inline constexpr uint32_t version = 1;
+inline constexpr size_t header_size = 8 + 2 * sizeof(uint32_t) + 4 * sizeof(uint64_t) + 4 * sizeof(uint32_t);
+inline constexpr size_t page_header_size = sizeof(uint32_t) + sizeof(uint16_t);
+inline constexpr size_t min_page_size = 256;
+inline constexpr size_t max_page_size = 1 << 16;
+
+struct header {
+    uint32_t page_size = 0;
+    uint64_t count = 0;
+    uint64_t page_count = 0;
+    uint64_t index_offset = 0;
+    uint64_t index_size = 0;
+    uint32_t key_size = 0;
+    uint32_t mapped_size = 0;
+    uint32_t index_crc = 0;
+};
+
+template <class T>
+constexpr uint32_t fixed_size() {
+    if constexpr (std::is_trivially_copyable_v<T>) {
+        return sizeof(T);
+    } else {
+        return 0;
+    }
+}
+
+inline std::string encode(const header& h) {
+    std::string out(magic, sizeof(magic));
+    wal_codec<uint32_t>::write(out, version);
+    wal_codec<uint32_t>::write(out, h.page_size);
+    wal_codec<uint64_t>::write(out, h.count);
+    wal_codec<uint64_t>::write(out, h.page_count);
+    wal_codec<uint64_t>::write(out, h.index_offset);
+    wal_codec<uint64_t>::write(out, h.index_size);
+    wal_codec<uint32_t>::write(out, h.key_size);
+    wal_codec<uint32_t>::write(out, h.mapped_size);
+    wal_codec<uint32_t>::write(out, h.index_crc);
+    wal_codec<uint32_t>::write(out, crc32(out));
+    return out;
+}
+
+inline header decode(std::string_view in) {
+    if (in.size() < header_size || std::memcmp(in.data(), magic, sizeof(magic)) != 0) {
+        throw std::runtime_error("Not a checkpoint file");
+    }
+    std::string_view checked = in.substr(0, header_size - sizeof(uint32_t));
+    in.remove_prefix(sizeof(magic));
+    if (wal_codec<uint32_t>::read(in) != version) {
+        throw std::runtime_error("Unsupported checkpoint version");
+    }
+    header h;
+    h.page_size = wal_codec<uint32_t>::read(in);
+    h.count = wal_codec<uint64_t>::read(in);
+    h.page_count = wal_codec<uint64_t>::read(in);
+    h.index_offset = wal_codec<uint64_t>::read(in);
+    h.index_size = wal_codec<uint64_t>::read(in);
+    h.key_size = wal_codec<uint32_t>::read(in);
+    h.mapped_size = wal_codec<uint32_t>::read(in);
+    h.index_crc = wal_codec<uint32_t>::read(in);
+    if (wal_codec<uint32_t>::read(in) != crc32(checked)) {
+        throw std::runtime_error("Corrupt checkpoint header");
+    }
+    return h;
+}
+
+} // checkpoint_format
+
+// Writes the sorted unique range [first, last) of key value pairs as a checkpoint. The file is written
+// under a temporary name, synced and renamed, and the directory synced after the rename, so `path` holds
+// either the old or the new checkpoint.
+template <class Key, class T, class Compare = std::less<Key>, class InputIt>
+void write_checkpoint(const std::string& path, InputIt first, InputIt last, size_t page_size = 4096,
+                      const Compare& comparator = Compare()) {
+    namespace format = checkpoint_format;
+    if (page_size < format::min_page_size || page_size > format::max_page_size) {
+        throw std::invalid_argument("Checkpoint page size must be between 256 bytes and 64 KiB");
+    }
+    std::string temp_path = path + ".tmp";
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "Cannot create " + temp_path);
+    }
+    auto write_all = [&](std::string_view data, uint64_t offset) {
+        while (!data.empty()) {
+            ssize_t count = ::pwrite(fd, data.data(), data.size(), static_cast<off_t>(offset));
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "Cannot write " + temp_path);
+            }
+            data.remove_prefix(static_cast<size_t>(count));
+            offset += static_cast<uint64_t>(count);
+        }
+    };
+    try {
+        format::header header;
+        header.page_size = static_cast<uint32_t>(page_size);
+        header.key_size = format::fixed_size<Key>();
+        header.mapped_size = format::fixed_size<T>();
+        std::string index_keys;
+        std::vector<uint64_t> index_offsets;
+        std::vector<uint16_t> offsets;
+        std::string records;
+        std::string record;
+        auto flush_page = [&] {
+            std::string page;
+            page.reserve(page_size);
+            page.resize(sizeof(uint32_t));
+            wal_codec<uint16_t>::write(page, static_cast<uint16_t>(offsets.size()));
+            size_t base = format::page_header_size + offsets.size() * sizeof(uint16_t);
+            for (uint16_t offset : offsets) {
+                wal_codec<uint16_t>::write(page, static_cast<uint16_t>(base + offset));
+            }
+            page += records;
+            page.resize(page_size);
+            uint32_t checksum = crc32(std::string_view(page).substr(sizeof(uint32_t)));
+            std::memcpy(page.data(), &checksum, sizeof(checksum));
+            write_all(page, ++header.page_count * page_size);
+            offsets.clear();
+            records.clear();
+        };
+        std::optional<Key> previous;
+        for (; first != last; ++first) {
+            const auto& [key, mapped] = *first;
+            record.clear();
+            wal_codec<Key>::write(record, key);
+            size_t key_bytes = record.size();
+            wal_codec<T>::write(record, mapped);
+            if (previous && !comparator(*previous, key)) {
+                throw std::invalid_argument("Range is not sorted");
+            }
+            previous = key;
+            if (format::page_header_size + sizeof(uint16_t) + record.size() > page_size) {
+                throw std::length_error("Record does not fit in a checkpoint page");
+            }
+            if (format::page_header_size + (offsets.size() + 1) * sizeof(uint16_t) + records.size() + record.size() >
+                page_size) {
+                flush_page();
+            }
+            if (offsets.empty()) {
+                index_offsets.push_back(index_keys.size());
+                index_keys.append(record, 0, key_bytes);
+            }
+            offsets.push_back(static_cast<uint16_t>(records.size()));
+            records += record;
+            ++header.count;
+        }
+        if (!offsets.empty()) {
+            flush_page();
+        }
+        std::string index;
+        index.reserve(index_offsets.size() * sizeof(uint64_t) + index_keys.size());
+        for (uint64_t offset : index_offsets) {
+            wal_codec<uint64_t>::write(index, offset);
+        }
+        index += index_keys;
+        header.index_offset = (header.page_count + 1) * page_size;
+        header.index_size = index.size();
+        header.index_crc = crc32(index);
+        write_all(index, header.index_offset);
+        write_all(format::encode(header), 0);
+        if (::ftruncate(fd, static_cast<off_t>(header.index_offset + header.index_size)) != 0) {
+            throw std::system_error(errno, std::generic_category(), "Cannot write " + temp_path);
+        }
+        if (::fdatasync(fd) != 0) {
+            throw std::system_error(errno, std::generic_category(), "Cannot sync " + temp_path);
+        }
+    } catch (...) {
+        ::close(fd);
+        ::unlink(temp_path.c_str());
+        throw;
+    }
+    ::close(fd);
+    if (::rename(temp_path.c_str(), path.c_str()) != 0) {
+        int code = errno;
+        ::unlink(temp_path.c_str());
+        throw std::system_error(code, std::generic_category(), "Cannot rename " + temp_path);
+    }
+    sync_parent_directory(path);
+}
+
+template <class Key, class T, class Compare, class Allocator, bool Threaded, template <class> class Link>
+void write_checkpoint(const std::string& path, acid_map<Key, T, Compare, Allocator, Threaded, Link>& map,
+                      size_t page_size = 4096) {
+    write_checkpoint<Key, T>(path, map.begin(), map.end(), page_size, map.key_comp());
+}
+
+// Read only access to a checkpoint through a private memory mapping. Opening reads and checks only the
+// header, pages are brought in by the page cache as lookups touch them, so a checkpoint of any size
+// serves lookups right away. materialize builds an acid_map from it in linear time, materialize_async
+// does so on another thread while the view keeps answering reads, verify checks every page checksum.
+template <class Key, class T, class Compare = std::less<Key>>
+class checkpoint_view {
+public:
+    using key_type = Key;
+    using mapped_type = T;
+    using value_type = std::pair<const Key, T>;
+    using size_type = std::size_t;
+    using key_compare = Compare;
+
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::pair<const Key, T>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+        iterator() = default;
+        value_type operator*() const {
+            std::string_view record = view->record(page, slot);
+            Key key = wal_codec<Key>::read(record);
+            return value_type(std::move(key), wal_codec<T>::read(record));
+        }
+        iterator& operator++() {
+            if (++slot == view->page_records(page)) {
+                ++page;
+                slot = 0;
+            }
+            return *this;
+        }
+        iterator operator++(int) {
+            iterator result = *this;
+            ++*this;
+            return result;
+        }
+        bool operator==(const iterator& other) const {
+            return page == other.page && slot == other.slot;
+        }
+        bool operator!=(const iterator& other) const {
+            return !(*this == other);
+        }
+    private:
+        friend class checkpoint_view;
+        iterator(const checkpoint_view* view, uint64_t page, size_t slot) : view(view), page(page), slot(slot) {}
+        const checkpoint_view* view = nullptr;
+        uint64_t page = 0;
+        size_t slot = 0;
+    };
+
+    explicit checkpoint_view(const std::string& path, const key_compare& comparator = key_compare())
+        : comparator(comparator) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "Cannot open " + path);
+        }
+        struct stat status{};
+        if (::fstat(fd, &status) != 0) {
+            int code = errno;
+            ::close(fd);
+            throw std::system_error(code, std::generic_category(), "Cannot open " + path);
+        }
+        mapped_size = static_cast<size_t>(status.st_size);
+        if (mapped_size < checkpoint_format::header_size) {
+            ::close(fd);
+            throw std::runtime_error("Not a checkpoint file");
+        }
+        void* address = ::mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        int code = errno;
+        ::close(fd);
+        if (address == MAP_FAILED) {
+            throw std::system_error(code, std::generic_category(), "Cannot map " + path);
+        }
+        data = static_cast<const char*>(address);
+        try {
+            header = checkpoint_format::decode(std::string_view(data, mapped_size));
+            if (header.key_size != checkpoint_format::fixed_size<Key>() ||
+                header.mapped_size != checkpoint_format::fixed_size<T>()) {
+                throw std::runtime_error("Checkpoint holds different key or mapped types");
+            }
+            if (header.page_size < checkpoint_format::min_page_size ||
+                header.page_size > checkpoint_format::max_page_size ||
+                header.index_offset != (header.page_count + 1) * header.page_size ||
+                header.index_size < header.page_count * sizeof(uint64_t) ||
+                header.index_offset + header.index_size > mapped_size) {
+                throw std::runtime_error("Corrupt checkpoint header");
+            }
+        } catch (...) {
+            ::munmap(const_cast<char*>(data), mapped_size);
+            throw;
+        }
+        size_t system_page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        size_t index_page = header.index_offset / system_page * system_page;
+        ::madvise(const_cast<char*>(data) + index_page, header.index_offset - index_page + header.index_size,
+                  MADV_WILLNEED);
+    }
+    checkpoint_view(const checkpoint_view&) = delete;
+    checkpoint_view& operator=(const checkpoint_view&) = delete;
+    ~checkpoint_view() {
+        ::munmap(const_cast<char*>(data), mapped_size);
+    }
+    iterator begin() const {
+        return iterator(this, 0, 0);
+    }
+    iterator end() const {
+        return iterator(this, header.page_count, 0);
+    }
+    iterator lower_bound(const key_type& key) const {
+        if (header.page_count == 0) {
+            return end();
+        }
+        uint64_t page = find_page(key);
+        size_t count = page_records(page);
+        size_t lo = 0;
+        size_t hi = count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (comparator(record_key(page, mid), key)) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        iterator result(this, page, lo);
+        if (lo == count) {
+            ++result.page;
+            result.slot = 0;
+        }
+        return result;
+    }
+    iterator find(const key_type& key) const {
+        iterator it = lower_bound(key);
+        if (it == end() || comparator(key, record_key(it.page, it.slot))) {
+            return end();
+        }
+        return it;
+    }
+    std::optional<mapped_type> get(const key_type& key) const {
+        iterator it = find(key);
+        if (it == end()) {
+            return std::nullopt;
+        }
+        std::string_view record = this->record(it.page, it.slot);
+        wal_codec<Key>::read(record);
+        return wal_codec<T>::read(record);
+    }
+    bool contains(const key_type& key) const {
+        return find(key) != end();
+    }
+    size_type count(const key_type& key) const {
+        return contains(key) ? 1 : 0;
+    }
+    size_type size() const {
+        return header.count;
+    }
+    bool empty() const {
+        return header.count == 0;
+    }
+    key_compare key_comp() const {
+        return comparator;
+    }
+    // Checks the index and every page against their checksums, touching the whole file.
+    bool verify() const {
+        if (crc32(std::string_view(data + header.index_offset, header.index_size)) != header.index_crc) {
+            return false;
+        }
+        for (uint64_t page = 0; page < header.page_count; page++) {
+            std::string_view bytes(page_data(page), header.page_size);
+            uint32_t checksum = wal_codec<uint32_t>::read(bytes);
+            if (crc32(bytes) != checksum) {
+                return false;
+            }
+        }
+        return true;
+    }
+    // Builds the in memory map from the sorted records without a single comparison based insert.
+    template <class Allocator = std::allocator<value_type>>
+    acid_map<Key, T, Compare, Allocator> materialize(const Allocator& allocator = Allocator()) const {
+        return acid_map<Key, T, Compare, Allocator>(sorted_unique, begin(), end(), allocator);
+    }
+    // Builds the map on a new thread. The view has to outlive the future and may serve lookups meanwhile.
+    template <class Allocator = std::allocator<value_type>>
+    std::future<std::unique_ptr<acid_map<Key, T, Compare, Allocator>>>
+    materialize_async(const Allocator& allocator = Allocator()) const {
+        return std::async(std::launch::async, [this, allocator] {
+            return std::make_unique<acid_map<Key, T, Compare, Allocator>>(sorted_unique, begin(), end(), allocator);
+        });
+    }
+private:
+    const char* page_data(uint64_t page) const {
+        return data + (page + 1) * header.page_size;
+    }
+    size_t page_records(uint64_t page) const {
+        std::string_view bytes(page_data(page) + sizeof(uint32_t), sizeof(uint16_t));
+        return wal_codec<uint16_t>::read(bytes);
+    }
+    std::string_view record(uint64_t page, size_t slot) const {
+        const char* base = page_data(page);
+        std::string_view offset(base + checkpoint_format::page_header_size + slot * sizeof(uint16_t),
+                                sizeof(uint16_t));
+        size_t start = wal_codec<uint16_t>::read(offset);
+        if (start >= header.page_size) {
+            throw std::runtime_error("Corrupt checkpoint page");
+        }
+        return std::string_view(base + start, header.page_size - start);
+    }
+    Key record_key(uint64_t page, size_t slot) const {
+        std::string_view bytes = record(page, slot);
+        return wal_codec<Key>::read(bytes);
+    }
+    Key index_key(uint64_t page) const {
+        std::string_view offset(data + header.index_offset + page * sizeof(uint64_t), sizeof(uint64_t));
+        uint64_t start = header.page_count * sizeof(uint64_t) + wal_codec<uint64_t>::read(offset);
+        if (start >= header.index_size) {
+            throw std::runtime_error("Corrupt checkpoint index");
+        }
+        std::string_view bytes(data + header.index_offset + start, header.index_size - start);
+        return wal_codec<Key>::read(bytes);
+    }
+    // The last page whose first key is not greater than key, or the first page.
+    uint64_t find_page(const key_type& key) const {
+        uint64_t lo = 0;
+        uint64_t hi = header.page_count;
+        while (hi - lo > 1) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (comparator(key, index_key(mid))) {
+                hi = mid;
+            } else {
+                lo = mid;
+            }
+        }
+        return lo;
+    }
+    key_compare comparator;
+    checkpoint_format::header header;
+    const char* data = nullptr;
+    size_t mapped_size = 0;
+};
+
+} // polyndrom
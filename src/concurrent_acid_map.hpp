@@ -0,0 +1,602 @@
+#pragma once
+
+#include "acid_map.hpp"
+#include "epoch.hpp"
+
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace polyndrom {
+
+// A thread-safe acid_map split into shards by key hash, every shard being an acid_map behind its own lock,
+// so writers on different shards never wait for each other and readers of a shard share its lock.
+// Iteration merges the shards in key order. It is weakly consistent: an iterator never yields an erased
+// element and survives concurrent erasure of the element it points to, but elements inserted behind the
+// positions it holds in other shards may be skipped. Access to mapped values through iterators is not
+// synchronized with writers of the same key or with lock free readers, use visit for that. An iterator keeps
+// a position in every shard and a heap of those shards ordered by key, so ++ locks one shard and costs
+// O(log shards) comparisons, while copying or destroying it locks every shard it still has a position in.
+// Lookups do not lock: every shard carries a sequence counter that writers make odd while they modify the
+// tree, readers traverse it optimistically and retry if the counter moved. Links are atomics and mapped values
+// read without locks are copied with relaxed atomic accesses, so a reader racing with a writer reads a stale
+// path, never a torn pointer. Nodes released by writers are reclaimed through an epoch_domain, so a reader never
+// touches freed memory.
+template <class Key, class T, class Compare = std::less<Key>, class Allocator = std::allocator<std::pair<const Key, T>>,
+          class Hash = std::hash<Key>>
+class concurrent_acid_map {
+private:
+    using self_type = concurrent_acid_map<Key, T, Compare, Allocator, Hash>;
+    using map_allocator_type = epoch_allocator<std::pair<const Key, T>, Allocator>;
+    using map_type = acid_map<Key, T, Compare, map_allocator_type, false, tree_link>;
+    using map_iterator_type = typename map_type::iterator;
+    using node_type = typename map_type::node_type;
+    static constexpr int max_height = 96;
+    // Elements cvisit copies out without locking, their mapped values are stored through store_mapped.
+    static constexpr bool lock_free_values = std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<T> &&
+                                             std::is_default_constructible_v<T>;
+    static constexpr size_t collect_threshold = 256;
+    struct alignas(64) shard {
+        shard(const Compare& comparator, const map_allocator_type& allocator)
+            : retired(allocator.retire_queue()), map(comparator, allocator) {}
+        void begin_write() {
+            version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+        void end_write() {
+            version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            if (retired.size() >= collect_threshold) {
+                retired.collect();
+            }
+        }
+        mutable std::shared_mutex mutex;
+        std::atomic<uint64_t> version{0};
+        epoch_retire_queue<Allocator>& retired;
+        map_type map;
+    };
+    // Holds the exclusive lock of a shard and keeps its sequence counter odd.
+    class write_lock {
+    public:
+        explicit write_lock(shard& s) : lock(s.mutex), s(s) {
+            s.begin_write();
+        }
+        ~write_lock() {
+            s.end_write();
+        }
+    private:
+        std::unique_lock<std::shared_mutex> lock;
+        shard& s;
+    };
+public:
+    using key_type = Key;
+    using mapped_type = T;
+    using value_type = std::pair<const Key, T>;
+    using size_type = std::size_t;
+    using key_compare = Compare;
+    using hasher = Hash;
+    using allocator_type = Allocator;
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = typename self_type::value_type;
+        using pointer = value_type*;
+        using reference = value_type&;
+        iterator() = default;
+        iterator(const iterator& other) : owner(other.owner), heap(other.heap), current(other.current) {
+            if (owner != nullptr) {
+                positions.resize(owner->shard_count);
+                for (size_type i : heap) {
+                    std::unique_lock lock(owner->shards[i]->mutex);
+                    positions[i] = other.positions[i];
+                }
+            }
+        }
+        iterator(iterator&& other) noexcept
+            : owner(std::exchange(other.owner, nullptr)), positions(std::move(other.positions)),
+              heap(std::move(other.heap)), current(std::exchange(other.current, npos)) {}
+        iterator& operator=(const iterator& other) {
+            if (this != &other) {
+                *this = iterator(other);
+            }
+            return *this;
+        }
+        iterator& operator=(iterator&& other) noexcept {
+            if (this != &other) {
+                reset();
+                owner = std::exchange(other.owner, nullptr);
+                positions = std::move(other.positions);
+                heap = std::move(other.heap);
+                current = std::exchange(other.current, npos);
+            }
+            return *this;
+        }
+        ~iterator() {
+            reset();
+        }
+        iterator& operator++() {
+            owner->advance(*this);
+            return *this;
+        }
+        iterator operator++(int) {
+            iterator other = *this;
+            ++*this;
+            return other;
+        }
+        value_type& operator*() {
+            return *positions[current];
+        }
+        value_type* operator->() {
+            return &*positions[current];
+        }
+        bool operator==(const iterator& other) const {
+            if (current == npos || other.current == npos) {
+                return current == other.current;
+            }
+            return map_type::node_of(positions[current]) == map_type::node_of(other.positions[other.current]);
+        }
+        bool operator!=(const iterator& other) const {
+            return !(*this == other);
+        }
+    private:
+        friend self_type;
+        static constexpr size_type npos = static_cast<size_type>(-1);
+        void reset() noexcept {
+            if (owner != nullptr) {
+                for (size_type i : heap) {
+                    std::unique_lock lock(owner->shards[i]->mutex);
+                    positions[i] = map_iterator_type();
+                }
+                heap.clear();
+                owner = nullptr;
+            }
+            current = npos;
+        }
+        self_type* owner = nullptr;
+        mutable std::vector<map_iterator_type> positions;
+        // The shards whose position is not at their end, as a heap with the smallest key on top. Positions
+        // of the other shards are empty and need no lock to copy or release.
+        std::vector<size_type> heap;
+        size_type current = npos;
+    };
+    // Buffers reads and writes of several keys and applies the writes atomically on commit, with optimistic
+    // concurrency control: commit locks every shard the transaction touched in index order, checks that
+    // each key read still has the value it had when read and only then applies the writes. Validating by
+    // value makes committed transactions serializable in commit order, mapped values must be comparable
+    // with ==. A transaction is used by one thread and must not outlive its map.
+    class transaction {
+    public:
+        // Returns the mapped value visible to the transaction, its own writes included.
+        std::optional<T> get(const key_type& key) {
+            if (auto it = find(writes, key); it != writes.end()) {
+                return it->second;
+            }
+            if (auto it = find(reads, key); it != reads.end()) {
+                return it->second;
+            }
+            std::optional<T> value;
+            owner->cvisit(key, [&](const value_type& element) {
+                value = element.second;
+            });
+            reads.emplace_back(key, value);
+            return value;
+        }
+        bool contains(const key_type& key) {
+            return get(key).has_value();
+        }
+        template <class M>
+        void insert_or_assign(const key_type& key, M&& mapped) {
+            write(key, std::optional<T>(std::forward<M>(mapped)));
+        }
+        void erase(const key_type& key) {
+            write(key, std::optional<T>());
+        }
+        // Returns false and discards the transaction if another commit changed a key it read, the
+        // transaction can then be retried from scratch.
+        bool commit() {
+            std::vector<std::pair<size_type, bool>> touched;
+            touched.reserve(reads.size() + writes.size());
+            for (auto& [key, value] : reads) {
+                touched.emplace_back(owner->shard_index(key), false);
+            }
+            for (auto& [key, value] : writes) {
+                touched.emplace_back(owner->shard_index(key), true);
+            }
+            std::sort(touched.begin(), touched.end(), [](const auto& lhs, const auto& rhs) {
+                return lhs.first < rhs.first || (lhs.first == rhs.first && lhs.second > rhs.second);
+            });
+            touched.erase(std::unique(touched.begin(), touched.end(), [](const auto& lhs, const auto& rhs) {
+                return lhs.first == rhs.first;
+            }), touched.end());
+            for (auto& [index, written] : touched) {
+                owner->shards[index]->mutex.lock();
+            }
+            bool valid = std::all_of(reads.begin(), reads.end(), [&](const auto& read) {
+                const node_type* node = owner->shard_for(read.first).map.find_node(read.first);
+                if (node == nullptr || !read.second) {
+                    return node == nullptr && !read.second;
+                }
+                return node->value.second == *read.second;
+            });
+            auto unlock = [&](bool end_writes) {
+                for (auto& [index, written] : touched) {
+                    if (end_writes && written) {
+                        owner->shards[index]->end_write();
+                    }
+                    owner->shards[index]->mutex.unlock();
+                }
+                rollback();
+            };
+            if (!valid) {
+                unlock(false);
+                return false;
+            }
+            for (auto& [index, written] : touched) {
+                if (written) {
+                    owner->shards[index]->begin_write();
+                }
+            }
+            try {
+                for (auto& [key, value] : writes) {
+                    shard& s = owner->shard_for(key);
+                    if (value) {
+                        auto [it, inserted] = s.map.try_emplace(key, *value);
+                        if (!inserted) {
+                            store_mapped(it->second, std::move(*value));
+                        }
+                        owner->count_inserted(inserted);
+                    } else {
+                        owner->element_count.fetch_sub(s.map.erase(key), std::memory_order_relaxed);
+                    }
+                }
+            } catch (...) {
+                // An allocation failure leaves the writes applied so far in place.
+                unlock(true);
+                throw;
+            }
+            unlock(true);
+            return true;
+        }
+        void rollback() {
+            reads.clear();
+            writes.clear();
+        }
+    private:
+        friend self_type;
+        // Transactions touch a handful of keys, the sets are searched linearly.
+        using entries = std::vector<std::pair<key_type, std::optional<T>>>;
+        explicit transaction(self_type* owner) : owner(owner) {
+            reads.reserve(4);
+            writes.reserve(4);
+        }
+        typename entries::iterator find(entries& set, const key_type& key) {
+            return std::find_if(set.begin(), set.end(), [&](const auto& entry) {
+                return !owner->comparator(entry.first, key) && !owner->comparator(key, entry.first);
+            });
+        }
+        void write(const key_type& key, std::optional<T>&& value) {
+            if (auto it = find(writes, key); it != writes.end()) {
+                it->second = std::move(value);
+            } else {
+                writes.emplace_back(key, std::move(value));
+            }
+        }
+        self_type* owner;
+        entries reads;
+        entries writes;
+    };
+    explicit concurrent_acid_map(size_type shard_count = default_shard_count(), const key_compare& comparator = key_compare(),
+                                 const hasher& hash = hasher(), const allocator_type& allocator = allocator_type())
+        : shard_count(std::max<size_type>(shard_count, 1)), comparator(comparator), hash(hash) {
+        shards.reserve(this->shard_count);
+        for (size_type i = 0; i < this->shard_count; i++) {
+            shards.push_back(std::make_unique<shard>(comparator, map_allocator_type(shard_allocator(allocator), domain)));
+        }
+    }
+    concurrent_acid_map(const concurrent_acid_map&) = delete;
+    concurrent_acid_map& operator=(const concurrent_acid_map&) = delete;
+    static size_type default_shard_count() {
+        return std::max<size_type>(16, 4 * std::thread::hardware_concurrency());
+    }
+    template <class V>
+    bool insert(V&& value) {
+        shard& s = shard_for(value.first);
+        write_lock lock(s);
+        return count_inserted(s.map.insert(std::forward<V>(value)).second);
+    }
+    template <class... Args>
+    bool emplace(Args&&... args) {
+        return insert(value_type(std::forward<Args>(args)...));
+    }
+    template <class... Args>
+    bool try_emplace(const key_type& key, Args&&... args) {
+        shard& s = shard_for(key);
+        write_lock lock(s);
+        return count_inserted(s.map.try_emplace(key, std::forward<Args>(args)...).second);
+    }
+    template <class M>
+    bool insert_or_assign(const key_type& key, M&& mapped) {
+        shard& s = shard_for(key);
+        write_lock lock(s);
+        auto [it, inserted] = s.map.try_emplace(key, std::forward<M>(mapped));
+        if (!inserted) {
+            store_mapped(it->second, std::forward<M>(mapped));
+        }
+        return count_inserted(inserted);
+    }
+    size_type erase(const key_type& key) {
+        shard& s = shard_for(key);
+        write_lock lock(s);
+        size_type erased = s.map.erase(key);
+        element_count.fetch_sub(erased, std::memory_order_relaxed);
+        return erased;
+    }
+    iterator erase(iterator pos) {
+        if (pos.current == iterator::npos) {
+            return pos;
+        }
+        shard& s = *shards[pos.current];
+        {
+            write_lock lock(s);
+            if (!map_type::node_of(pos.positions[pos.current])->is_deleted) {
+                s.map.erase(pos.positions[pos.current]);
+                element_count.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+        advance(pos);
+        return pos;
+    }
+    // Calls f with the element under the shard's exclusive lock, f may modify the mapped value. Elements
+    // that are read without locking are passed as a copy, which is stored back afterwards.
+    template <class F>
+    bool visit(const key_type& key, F&& f) {
+        shard& s = shard_for(key);
+        write_lock lock(s);
+        node_type* node = s.map.find_node(key);
+        if (node == nullptr) {
+            return false;
+        }
+        if constexpr (lock_free_values) {
+            value_type element = node->value;
+            f(element);
+            store_mapped(node->value.second, element.second);
+        } else {
+            f(node->value);
+        }
+        return true;
+    }
+    // Calls f with a read only view of the element. Trivially copyable elements with default constructible
+    // mapped values are copied out without locking and f gets the copy, other elements are passed under the
+    // shard's shared lock.
+    template <class F>
+    bool cvisit(const key_type& key, F&& f) const {
+        const shard& s = shard_for(key);
+        if constexpr (lock_free_values) {
+            auto value = read(s, key, [](const node_type* node) {
+                if (node == nullptr) {
+                    return std::optional<value_type>();
+                }
+                T mapped;
+                copy_relaxed(&mapped, &node->value.second, sizeof(T));
+                return std::optional<value_type>(std::in_place, node->key(), mapped);
+            });
+            if (!value) {
+                return false;
+            }
+            f(static_cast<const value_type&>(*value));
+        } else {
+            std::shared_lock lock(s.mutex);
+            const node_type* node = s.map.find_node(key);
+            if (node == nullptr) {
+                return false;
+            }
+            f(static_cast<const value_type&>(node->value));
+        }
+        return true;
+    }
+    bool contains(const key_type& key) const {
+        return read(shard_for(key), key, [](const node_type* node) {
+            return node != nullptr;
+        });
+    }
+    size_type count(const key_type& key) const {
+        return contains(key) ? 1 : 0;
+    }
+    size_type size() const {
+        return element_count.load(std::memory_order_relaxed);
+    }
+    bool empty() const {
+        return size() == 0;
+    }
+    void clear() {
+        for (size_type i = 0; i < shard_count; i++) {
+            write_lock lock(*shards[i]);
+            element_count.fetch_sub(shards[i]->map.size(), std::memory_order_relaxed);
+            shards[i]->map.clear();
+        }
+    }
+    iterator begin() {
+        return seek([](map_type& map) {
+            return map.begin();
+        });
+    }
+    iterator end() {
+        return iterator();
+    }
+    iterator lower_bound(const key_type& key) {
+        return seek([&](map_type& map) {
+            return map.lower_bound(key);
+        });
+    }
+    iterator find(const key_type& key) {
+        iterator it = lower_bound(key);
+        if (it != end() && comparator(key, it->first)) {
+            return end();
+        }
+        return it;
+    }
+    transaction begin_transaction() {
+        return transaction(this);
+    }
+    key_compare key_comp() const {
+        return comparator;
+    }
+    size_type shards_size() const {
+        return shard_count;
+    }
+private:
+    static allocator_type shard_allocator(const allocator_type& allocator) {
+        if constexpr (is_node_pool_allocator<allocator_type>::value) {
+            return allocator_type();
+        } else {
+            return allocator;
+        }
+    }
+    size_type shard_index(const key_type& key) const {
+        return hash(key) % shard_count;
+    }
+    shard& shard_for(const key_type& key) {
+        return *shards[shard_index(key)];
+    }
+    const shard& shard_for(const key_type& key) const {
+        return *shards[shard_index(key)];
+    }
+    // Assigns the mapped value of an element, byte by byte with relaxed atomic stores if readers may copy it
+    // without locking. A reader racing with the store gets a torn copy, which the sequence counter discards.
+    template <class M>
+    static void store_mapped(T& target, M&& mapped) {
+        if constexpr (lock_free_values) {
+            T value(std::forward<M>(mapped));
+            copy_relaxed(&target, &value, sizeof(T));
+        } else {
+            target = std::forward<M>(mapped);
+        }
+    }
+    // Copies an object representation with relaxed atomic byte accesses, either side may be shared.
+    static void copy_relaxed(void* to, const void* from, size_t size) {
+        auto* target = static_cast<unsigned char*>(to);
+        auto* source = static_cast<const unsigned char*>(from);
+        for (size_t i = 0; i < size; i++) {
+            __atomic_store_n(target + i, __atomic_load_n(source + i, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+        }
+    }
+    bool count_inserted(bool inserted) {
+        if (inserted) {
+            element_count.fetch_add(1, std::memory_order_relaxed);
+        }
+        return inserted;
+    }
+    // Runs a lookup without locking and hands the node found to extract, retrying until no writer modified
+    // the shard in between. The traversal is bounded, a path that is inconsistent because of a concurrent
+    // rotation may not end by itself.
+    template <class Extract>
+    auto read(const shard& s, const key_type& key, Extract extract) const {
+        epoch_domain::guard guard = domain.pin();
+        while (true) {
+            uint64_t version = s.version.load(std::memory_order_acquire);
+            if ((version & 1) == 0) {
+                bool complete = true;
+                const node_type* node = s.map.root.acquire();
+                for (int depth = 0; node != nullptr; depth++) {
+                    int cmp = s.map.compare(key, node->key());
+                    if (cmp == 0) {
+                        break;
+                    }
+                    if (depth == max_height) {
+                        complete = false;
+                        break;
+                    }
+                    node = cmp < 0 ? node->left.acquire() : node->right.acquire();
+                }
+                auto result = extract(node);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (complete && s.version.load(std::memory_order_relaxed) == version) {
+                    return result;
+                }
+            }
+            std::this_thread::yield();
+        }
+    }
+    template <class Position>
+    iterator seek(Position position) {
+        iterator it;
+        it.owner = this;
+        it.positions.resize(shard_count);
+        for (size_type i = 0; i < shard_count; i++) {
+            std::unique_lock lock(shards[i]->mutex);
+            it.positions[i] = position(shards[i]->map);
+            if (map_type::node_of(it.positions[i]) != nullptr) {
+                it.heap.push_back(i);
+            }
+        }
+        std::make_heap(it.heap.begin(), it.heap.end(), heap_order(it));
+        select(it);
+        return it;
+    }
+    void advance(iterator& it) {
+        shard& s = *shards[it.current];
+        std::pop_heap(it.heap.begin(), it.heap.end(), heap_order(it));
+        {
+            std::unique_lock lock(s.mutex);
+            map_iterator_type& position = it.positions[it.current];
+            node_type* node = map_type::node_of(position);
+            if (node->is_deleted) {
+                position = s.map.upper_bound(node->key());
+            } else {
+                ++position;
+            }
+        }
+        push_back_shard(it);
+        select(it);
+    }
+    // Picks the shard holding the smallest key, the top of the heap. Keys are immutable and the nodes are
+    // kept alive by the iterator, so they are compared without locks; only the chosen one is checked for
+    // erasure.
+    void select(iterator& it) {
+        while (!it.heap.empty()) {
+            size_type top = it.heap.front();
+            node_type* best = map_type::node_of(it.positions[top]);
+            {
+                std::unique_lock lock(shards[top]->mutex);
+                if (!best->is_deleted) {
+                    it.current = top;
+                    return;
+                }
+                std::pop_heap(it.heap.begin(), it.heap.end(), heap_order(it));
+                it.positions[top] = shards[top]->map.lower_bound(best->key());
+            }
+            push_back_shard(it);
+        }
+        it.current = iterator::npos;
+    }
+    // Puts the shard popped to the back of the heap back in, unless its position reached the end.
+    void push_back_shard(iterator& it) {
+        if (map_type::node_of(it.positions[it.heap.back()]) != nullptr) {
+            std::push_heap(it.heap.begin(), it.heap.end(), heap_order(it));
+        } else {
+            it.heap.pop_back();
+        }
+    }
+    auto heap_order(const iterator& it) const {
+        return [this, &it](size_type lhs, size_type rhs) {
+            return comparator(map_type::node_of(it.positions[rhs])->key(), map_type::node_of(it.positions[lhs])->key());
+        };
+    }
+    epoch_domain domain;
+    size_type shard_count;
+    std::vector<std::unique_ptr<shard>> shards;
+    std::atomic<size_type> element_count{0};
+    key_compare comparator;
+    hasher hash;
+};
+
+} // polyndrom
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "concurrent_acid_map.hpp"
+#include "write_ahead_log.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace polyndrom {
+
+// A concurrent_acid_map whose writes are recorded in a write ahead log and replayed when the same file
+// is opened again. A write is appended to the log and applied to the map under a per key lock, so the
+// log holds the writes of every key in the order the map saw them. The map only changes once the log
+// made the write durable as the durability level demands, so readers never see a write that may be
+// lost and a write whose flush fails leaves the map as it was. A logged write the map then fails to apply
+// is followed in the log by a record of the element as the map holds it. Once the log grows past compaction_size
+// and twice its size after the last compaction, it is rewritten as one record per element.
+// Keys and mapped values are stored through wal_codec.
+template <class Key, class T, class Compare = std::less<Key>, class Allocator = std::allocator<std::pair<const Key, T>>,
+          class Hash = std::hash<Key>>
+class durable_acid_map {
+public:
+    using map_type = concurrent_acid_map<Key, T, Compare, Allocator, Hash>;
+    using key_type = Key;
+    using mapped_type = T;
+    using value_type = std::pair<const Key, T>;
+    using size_type = std::size_t;
+    using iterator = typename map_type::iterator;
+    static constexpr size_t default_compaction_size = size_t(64) << 20;
+    explicit durable_acid_map(const std::string& path, durability level = durability::group,
+                              size_type shard_count = map_type::default_shard_count(),
+                              size_t compaction_size = default_compaction_size)
+        : map(shard_count), log(path, level), stripes(map.shards_size()), compaction_size(compaction_size),
+          next_compaction(compaction_size) {
+        log.replay([this](std::string_view payload) {
+            apply(payload);
+        });
+    }
+    template <class M>
+    bool insert_or_assign(const key_type& key, M&& mapped) {
+        bool inserted;
+        write(operation::assign, key, &mapped, [&] {
+            inserted = map.insert_or_assign(key, std::forward<M>(mapped));
+        });
+        return inserted;
+    }
+    template <class M>
+    bool try_emplace(const key_type& key, M&& mapped) {
+        bool inserted;
+        write(operation::insert, key, &mapped, [&] {
+            inserted = map.try_emplace(key, std::forward<M>(mapped));
+        });
+        return inserted;
+    }
+    size_type erase(const key_type& key) {
+        size_type erased;
+        write(operation::erase, key, static_cast<const T*>(nullptr), [&] {
+            erased = map.erase(key);
+        });
+        return erased;
+    }
+    template <class F>
+    bool cvisit(const key_type& key, F&& f) const {
+        return map.cvisit(key, std::forward<F>(f));
+    }
+    bool contains(const key_type& key) const {
+        return map.contains(key);
+    }
+    size_type size() const {
+        return map.size();
+    }
+    bool empty() const {
+        return map.empty();
+    }
+    iterator begin() {
+        return map.begin();
+    }
+    iterator end() {
+        return map.end();
+    }
+    // Bytes of the log on stable storage or waiting in the file system cache.
+    size_t log_size() const {
+        return log.size();
+    }
+    // Rewrites the log as one record per element, blocking writers meanwhile.
+    void compact() {
+        std::lock_guard lock(compaction_mutex);
+        compact_locked();
+    }
+private:
+    enum class operation : uint8_t { assign = 1, insert = 2, erase = 3 };
+    struct alignas(64) stripe {
+        std::mutex mutex;
+    };
+    template <class M>
+    static void encode(std::string& payload, operation op, const key_type& key, const M* mapped) {
+        wal_codec<uint8_t>::write(payload, static_cast<uint8_t>(op));
+        wal_codec<Key>::write(payload, key);
+        if (mapped != nullptr) {
+            wal_codec<T>::write(payload, *mapped);
+        }
+    }
+    // Writes of other stripes share the flush while this one waits for it with its stripe locked.
+    template <class M, class Apply>
+    void write(operation op, const key_type& key, const M* mapped, Apply apply) {
+        std::string payload;
+        encode(payload, op, key, mapped);
+        {
+            std::lock_guard lock(stripes[hash(key) % stripes.size()].mutex);
+            log.wait_durable(log.append(payload));
+            try {
+                apply();
+            } catch (...) {
+                log_element(key);
+                throw;
+            }
+        }
+        if (log.size() >= next_compaction.load(std::memory_order_relaxed)) {
+            std::unique_lock lock(compaction_mutex, std::try_to_lock);
+            if (lock.owns_lock() && log.size() >= next_compaction.load(std::memory_order_relaxed)) {
+                try {
+                    compact_locked();
+                } catch (const std::exception&) {
+                    // The write itself is durable and the old log stays in use, the next write retries.
+                }
+            }
+        }
+    }
+    // Logs the element of key as the map holds it, so that replay ends in the same state as the map.
+    void log_element(const key_type& key) {
+        std::string payload;
+        bool found = map.cvisit(key, [&](const value_type& element) {
+            encode(payload, operation::assign, key, &element.second);
+        });
+        if (!found) {
+            encode(payload, operation::erase, key, static_cast<const T*>(nullptr));
+        }
+        log.wait_durable(log.append(payload));
+    }
+    void compact_locked() {
+        std::vector<std::unique_lock<std::mutex>> locks;
+        locks.reserve(stripes.size());
+        for (stripe& s : stripes) {
+            locks.emplace_back(s.mutex);
+        }
+        log.rewrite([this](auto emit) {
+            std::string payload;
+            for (auto& [key, mapped] : map) {
+                payload.clear();
+                encode(payload, operation::assign, key, &mapped);
+                emit(payload);
+            }
+        });
+        next_compaction.store(std::max(compaction_size, 2 * log.size()), std::memory_order_relaxed);
+    }
+    void apply(std::string_view payload) {
+        auto op = static_cast<operation>(wal_codec<uint8_t>::read(payload));
+        Key key = wal_codec<Key>::read(payload);
+        switch (op) {
+            case operation::assign:
+                map.insert_or_assign(key, wal_codec<T>::read(payload));
+                break;
+            case operation::insert:
+                map.try_emplace(key, wal_codec<T>::read(payload));
+                break;
+            case operation::erase:
+                map.erase(key);
+                break;
+            default:
+                throw std::runtime_error("Unknown log record");
+        }
+    }
+    map_type map;
+    write_ahead_log log;
+    std::vector<stripe> stripes;
+    Hash hash;
+    size_t compaction_size;
+    std::atomic<size_t> next_compaction;
+    std::mutex compaction_mutex;
+};
+
+} // polyndrom
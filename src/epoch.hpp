@@ -0,0 +1,186 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <utility>
+
+namespace polyndrom {
+
+// Epoch based reclamation. Readers pin the current epoch for the duration of a lock free traversal, memory
+// retired while the global epoch was e is freed once the epoch reaches e + 2, when no reader that could
+// have seen it is still pinned.
+class epoch_domain {
+public:
+    static constexpr size_t slot_count = 128;
+    class guard {
+    public:
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+        ~guard() {
+            slot->store(0, std::memory_order_release);
+        }
+    private:
+        friend epoch_domain;
+        explicit guard(std::atomic<uint64_t>* slot) : slot(slot) {}
+        std::atomic<uint64_t>* slot;
+    };
+    epoch_domain() = default;
+    epoch_domain(const epoch_domain&) = delete;
+    epoch_domain& operator=(const epoch_domain&) = delete;
+    guard pin() const {
+        static std::atomic<size_t> next_home{0};
+        thread_local size_t home = next_home.fetch_add(1, std::memory_order_relaxed);
+        uint64_t epoch = global.load();
+        for (size_t i = home;; i++) {
+            std::atomic<uint64_t>& slot = slots[i % slot_count].epoch;
+            uint64_t expected = 0;
+            if (slot.load(std::memory_order_relaxed) == 0 && slot.compare_exchange_strong(expected, epoch)) {
+                while (global.load() != epoch) {
+                    epoch = global.load();
+                    slot.store(epoch);
+                }
+                return guard(&slot);
+            }
+            if (i - home + 1 == slot_count) {
+                std::this_thread::yield();
+            }
+        }
+    }
+    uint64_t current() const {
+        return global.load();
+    }
+    // Moves the global epoch forward if every pinned reader has observed it and returns the result.
+    uint64_t try_advance() {
+        uint64_t epoch = global.load();
+        for (const slot& s : slots) {
+            uint64_t pinned = s.epoch.load();
+            if (pinned != 0 && pinned != epoch) {
+                return epoch;
+            }
+        }
+        global.compare_exchange_strong(epoch, epoch + 1);
+        return global.load();
+    }
+private:
+    struct alignas(64) slot {
+        std::atomic<uint64_t> epoch{0};
+    };
+    std::atomic<uint64_t> global{1};
+    mutable slot slots[slot_count];
+};
+
+// Destructions and deallocations waiting for their epoch, in the order they were requested.
+// Not thread safe, every queue belongs to a single writer at a time.
+template <class Allocator>
+class epoch_retire_queue {
+public:
+    using action_type = void (*)(Allocator&, void*, size_t);
+    epoch_retire_queue(const Allocator& allocator, epoch_domain& domain) : allocator(allocator), domain(domain) {}
+    epoch_retire_queue(const epoch_retire_queue&) = delete;
+    epoch_retire_queue& operator=(const epoch_retire_queue&) = delete;
+    ~epoch_retire_queue() {
+        while (!retired.empty()) {
+            run_front();
+        }
+    }
+    void retire(void* ptr, size_t n, action_type action) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        retired.push_back({ptr, n, action, domain.current()});
+    }
+    void collect() {
+        uint64_t epoch = domain.try_advance();
+        while (!retired.empty() && retired.front().epoch + 2 <= epoch) {
+            run_front();
+        }
+    }
+    size_t size() const {
+        return retired.size();
+    }
+private:
+    struct record {
+        void* ptr;
+        size_t n;
+        action_type action;
+        uint64_t epoch;
+    };
+    void run_front() {
+        record front = retired.front();
+        retired.pop_front();
+        front.action(allocator, front.ptr, front.n);
+    }
+    Allocator allocator;
+    epoch_domain& domain;
+    std::deque<record> retired;
+};
+
+// Allocator adaptor that defers destroy and deallocate through an epoch_retire_queue, so that
+// lock free readers may still dereference a node after a writer unlinked and released it.
+// Constructed objects are published with a release fence, a reader that finds a pointer to
+// a new object by following links sees it fully constructed.
+template <class T, class Allocator = std::allocator<T>>
+class epoch_allocator {
+private:
+    using base_traits = std::allocator_traits<Allocator>;
+    using queue_type = epoch_retire_queue<Allocator>;
+    template <class U>
+    using rebound = typename base_traits::template rebind_alloc<U>;
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    template <class U>
+    struct rebind {
+        using other = epoch_allocator<U, Allocator>;
+    };
+    epoch_allocator(const Allocator& allocator, epoch_domain& domain)
+        : base(allocator), queue(std::make_shared<queue_type>(allocator, domain)) {}
+    template <class U>
+    epoch_allocator(const epoch_allocator<U, Allocator>& other) noexcept : base(other.base), queue(other.queue) {}
+    T* allocate(size_t n) {
+        return std::allocator_traits<rebound<T>>::allocate(base, n);
+    }
+    void deallocate(T* ptr, size_t n) {
+        queue->retire(ptr, n, &deallocate_now);
+    }
+    template <class U, class... Args>
+    void construct(U* ptr, Args&&... args) {
+        std::allocator_traits<rebound<T>>::construct(base, ptr, std::forward<Args>(args)...);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+    template <class U>
+    void destroy(U* ptr) {
+        queue->retire(ptr, 1, &destroy_now<U>);
+    }
+    queue_type& retire_queue() const {
+        return *queue;
+    }
+    template <class U>
+    bool operator==(const epoch_allocator<U, Allocator>& other) const {
+        return queue == other.queue;
+    }
+    template <class U>
+    bool operator!=(const epoch_allocator<U, Allocator>& other) const {
+        return queue != other.queue;
+    }
+private:
+    template <class U, class A>
+    friend class epoch_allocator;
+    static void deallocate_now(Allocator& base, void* ptr, size_t n) {
+        rebound<T> allocator(base);
+        std::allocator_traits<rebound<T>>::deallocate(allocator, static_cast<T*>(ptr), n);
+    }
+    template <class U>
+    static void destroy_now(Allocator& base, void* ptr, size_t) {
+        rebound<U> allocator(base);
+        std::allocator_traits<rebound<U>>::destroy(allocator, static_cast<U*>(ptr));
+    }
+    rebound<T> base;
+    std::shared_ptr<queue_type> queue;
+};
+
+} // polyndrom
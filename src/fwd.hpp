@@ -6,11 +6,16 @@
 template <class Tree>
 class tree_verifier;
 
-template <class Key, class T, class Compare, class Allocator>
+template <class Key, class T, class Compare, class Allocator, bool Threaded, template <class> class Link>
 class acid_map;
 
-template <class V, class Allocator>
+template <class V, bool Threaded, template <class> class Link>
+class map_node;
+
+template <class V, class Allocator, bool Threaded, template <class> class Link>
 class node_pointer;
 
 template <class Map>
-class map_iterator;
\ No newline at end of file
+class map_iterator;
+template <class Map, class K>
+class map_range;
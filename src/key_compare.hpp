@@ -0,0 +1,92 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#if defined(__cpp_lib_three_way_comparison)
+#include <compare>
+#endif
+
+namespace polyndrom {
+
+template <class Compare, class K1, class K2, class = void>
+struct has_compare_member : std::false_type {};
+
+template <class Compare, class K1, class K2>
+struct has_compare_member<Compare, K1, K2, std::void_t<decltype(std::declval<const Compare&>().compare(
+    std::declval<const K1&>(), std::declval<const K2&>()))>> : std::true_type {};
+
+template <class Key, class Compare>
+struct is_default_less : std::bool_constant<std::is_same_v<Compare, std::less<Key>> ||
+                                            std::is_same_v<Compare, std::less<>>> {};
+
+template <class Key, class K1, class K2>
+struct is_string_comparable : std::false_type {};
+
+template <class CharT, class Traits, class Alloc, class K1, class K2>
+struct is_string_comparable<std::basic_string<CharT, Traits, Alloc>, K1, K2>
+    : std::bool_constant<std::is_convertible_v<const K1&, std::basic_string_view<CharT, Traits>> &&
+                         std::is_convertible_v<const K2&, std::basic_string_view<CharT, Traits>>> {};
+
+// Returns a negative value, zero or a positive value like strcmp, using a single comparison whenever
+// the comparator provides compare(lhs, rhs), or std::less is used with strings or types having <=>.
+template <class Key, class Compare, class K1, class K2>
+int three_way_compare(const Compare& comparator, const K1& lhs, const K2& rhs) {
+    if constexpr (has_compare_member<Compare, K1, K2>::value) {
+        auto result = comparator.compare(lhs, rhs);
+        return result < 0 ? -1 : (result > 0 ? 1 : 0);
+    } else if constexpr (is_default_less<Key, Compare>::value && is_string_comparable<Key, K1, K2>::value) {
+        using view_type = std::basic_string_view<typename Key::value_type, typename Key::traits_type>;
+        return view_type(lhs).compare(view_type(rhs));
+#if defined(__cpp_lib_three_way_comparison)
+    } else if constexpr (is_default_less<Key, Compare>::value && std::three_way_comparable_with<K1, K2>) {
+        auto result = lhs <=> rhs;
+        return result < 0 ? -1 : (result > 0 ? 1 : 0);
+#endif
+    } else {
+        if (comparator(lhs, rhs)) {
+            return -1;
+        }
+        return comparator(rhs, lhs) ? 1 : 0;
+    }
+}
+
+// Whether emplace can read the key off its arguments, so that it looks the key up before it builds a node.
+template <class Key, class... Args>
+struct is_key_extractable : std::false_type {};
+
+template <class Key, class First, class Second>
+struct is_key_extractable<Key, std::pair<First, Second>> : std::is_same<std::remove_cv_t<First>, Key> {};
+
+template <class Key, class Mapped>
+struct is_key_extractable<Key, Key, Mapped> : std::true_type {};
+
+template <class Key, class... KeyArgs, class... MappedArgs>
+struct is_key_extractable<Key, std::piecewise_construct_t, std::tuple<KeyArgs...>, std::tuple<MappedArgs...>>
+    : std::is_constructible<Key, const std::remove_reference_t<KeyArgs>&...> {};
+
+template <class Key, class First, class Second>
+const Key& extract_key(const std::pair<First, Second>& value) {
+    return value.first;
+}
+
+template <class Key, class Mapped>
+const Key& extract_key(const Key& key, const Mapped&) {
+    return key;
+}
+
+template <class Key, class KeyArgs, class MappedArgs>
+decltype(auto) extract_key(std::piecewise_construct_t, const KeyArgs& key_args, const MappedArgs&) {
+    if constexpr (std::tuple_size_v<KeyArgs> == 1 &&
+                  std::is_same_v<std::decay_t<std::tuple_element_t<0, KeyArgs>>, Key>) {
+        return static_cast<const Key&>(std::get<0>(key_args));
+    } else {
+        return std::make_from_tuple<Key>(key_args);
+    }
+}
+
+} // polyndrom
@@ -10,7 +10,7 @@ private:
     using node_ptr = typename Map::node_ptr;
 public:
     using iterator_category = std::bidirectional_iterator_tag;
-    using difference_type = size_t;
+    using difference_type = std::ptrdiff_t;
     using value_type = typename Map::value_type;
     using pointer = value_type*;
     using reference = value_type&;
@@ -38,6 +38,23 @@ public:
         --*this;
         return other;
     }
+    map_iterator& operator+=(difference_type offset) {
+        node = node.advance(offset);
+        return *this;
+    }
+    map_iterator& operator-=(difference_type offset) {
+        node = node.advance(-offset);
+        return *this;
+    }
+    map_iterator operator+(difference_type offset) const {
+        return map_iterator(node.advance(offset));
+    }
+    map_iterator operator-(difference_type offset) const {
+        return map_iterator(node.advance(-offset));
+    }
+    difference_type operator-(const map_iterator& other) const {
+        return other.node.distance(node);
+    }
     value_type& operator*() {
         return node->value;
     }
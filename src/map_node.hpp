@@ -2,41 +2,228 @@
 
 #include "fwd.hpp"
 
-template <class V, class Allocator>
-class node_pointer {
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+// A child link of the tree, by default a plain pointer.
+template <class Node>
+using plain_link = Node*;
+
+// The child link of the trees of concurrent_acid_map, whose readers follow links without locking while a
+// writer rotates the tree. Stores release, so a reader that loads a link with acquire sees the node it
+// points to constructed; on x86 both compile to plain moves.
+template <class Node>
+class tree_link {
+public:
+    tree_link(Node* node = nullptr) noexcept : node(node) {}
+    tree_link(const tree_link& other) noexcept : node(other.get()) {}
+    tree_link& operator=(const tree_link& other) noexcept {
+        return *this = other.get();
+    }
+    tree_link& operator=(Node* value) noexcept {
+        node.store(value, std::memory_order_release);
+        return *this;
+    }
+    operator Node*() const noexcept {
+        return get();
+    }
+    Node* operator->() const noexcept {
+        return get();
+    }
+    Node* get() const noexcept {
+        return node.load(std::memory_order_relaxed);
+    }
+    // Loads a link for a lock free reader, the node it points to is seen fully constructed.
+    Node* acquire() const noexcept {
+        return node.load(std::memory_order_acquire);
+    }
 private:
-    class map_node {
-    public:
-        template <class... Args>
-        map_node(Args&& ... args) : value(std::forward<Args>(args)...) {}
-        ~map_node() = default;
-        const auto& key() {
-            return value.first;
-        }
-        node_pointer left = nullptr;
-        node_pointer right = nullptr;
-        node_pointer parent = nullptr;
-        int8_t height = 1;
-        size_t ref_count = 0;
-        bool is_deleted = false;
-        V value;
-    };
+    std::atomic<Node*> node;
+};
+
+// In-order neighbour links kept by threaded nodes, so stepping an iterator is a single load.
+template <class Node, bool Threaded>
+struct node_links {};
+
+template <class Node>
+struct node_links<Node, true> {
+    Node* successor = nullptr;
+    Node* predecessor = nullptr;
+};
+
+// The map a node belongs to. Erased nodes no longer hold a place in the tree, so where they step to and
+// their position are looked up by key in the map that erased them, which also destroys them.
+template <class Node>
+class node_owner {
+public:
+    // The live node ++ or -- moves to from an erased node: the first after or the last before its key.
+    virtual Node* erased_step(const Node* node, bool forward) const = 0;
+    // The index of a node in key order, of the node following its key for erased nodes and the number of
+    // nodes for nullptr.
+    virtual size_t position(const Node* node) const = 0;
+    // The live node at index in key order, nullptr past the last one.
+    virtual Node* node_at(size_t index) const = 0;
+    // Destroys an erased node the last iterator let go of.
+    virtual void destroy_erased(Node* node) = 0;
+protected:
+    ~node_owner() = default;
+};
+
+template <class V, bool Threaded = false, template <class> class Link = plain_link>
+class map_node : public node_links<map_node<V, Threaded, Link>, Threaded> {
 public:
-    using allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<map_node>;
-    node_pointer() = default;
     template <class... Args>
-    node_pointer(allocator_type& allocator, Args&&... args) : allocator(&allocator) {
-        owned_node = std::allocator_traits<allocator_type>::allocate(allocator, 1);
-        std::allocator_traits<allocator_type>::construct(allocator, owned_node, std::forward<Args>(args)...);
-        owned_node->ref_count += 1;
+    map_node(Args&& ... args) : value(std::forward<Args>(args)...) {}
+    ~map_node() = default;
+    const auto& key() const {
+        return value.first;
+    }
+    static map_node* prev(map_node* node) {
+        if constexpr (Threaded) {
+            return node->predecessor;
+        }
+        if (node->left != nullptr) {
+            return max(node->left);
+        }
+        return nearest_right_ancestor(node);
+    }
+    static map_node* next(map_node* node) {
+        if constexpr (Threaded) {
+            return node->successor;
+        }
+        if (node->right != nullptr) {
+            return min(node->right);
+        }
+        return nearest_left_ancestor(node);
+    }
+    static map_node* min(map_node* node) {
+        while (node->left != nullptr) {
+            node = node->left;
+        }
+        return node;
+    }
+    static map_node* max(map_node* node) {
+        while (node->right != nullptr) {
+            node = node->right;
+        }
+        return node;
+    }
+    static map_node* nearest_left_ancestor(map_node* node) {
+        map_node* parent = node->parent;
+        while (parent != nullptr && parent->left != node) {
+            node = parent;
+            parent = node->parent;
+        }
+        return parent;
+    }
+    static map_node* nearest_right_ancestor(map_node* node) {
+        map_node* parent = node->parent;
+        while (parent != nullptr && parent->right != node) {
+            node = parent;
+            parent = node->parent;
+        }
+        return parent;
+    }
+    // Makes before and after neighbours in the links of threaded nodes, either may be nullptr.
+    static void link(map_node* before, map_node* after) {
+        if constexpr (Threaded) {
+            if (before != nullptr) {
+                before->successor = after;
+            }
+            if (after != nullptr) {
+                after->predecessor = before;
+            }
+        }
+    }
+    static size_t subtree_size(const map_node* node) {
+        return node == nullptr ? 0 : node->size;
+    }
+    static map_node* root_of(map_node* node) {
+        while (node->parent != nullptr) {
+            node = node->parent;
+        }
+        return node;
     }
+    // Number of nodes preceding a live node in the whole tree.
+    static size_t rank(const map_node* node) {
+        size_t result = subtree_size(node->left);
+        for (; node->parent != nullptr; node = node->parent) {
+            if (node->parent->right == node) {
+                result += subtree_size(node->parent->left) + 1;
+            }
+        }
+        return result;
+    }
+    static map_node* select(map_node* node, size_t index) {
+        while (node != nullptr) {
+            size_t left_size = subtree_size(node->left);
+            if (index < left_size) {
+                node = node->left;
+            } else if (index > left_size) {
+                index -= left_size + 1;
+                node = node->right;
+            } else {
+                break;
+            }
+        }
+        return node;
+    }
+    // Moves a live node by offset positions in O(log n). Moving before the first or past the last node gives
+    // nullptr, like next and prev.
+    static map_node* advance(map_node* node, ptrdiff_t offset) {
+        if (offset == 0) {
+            return node;
+        }
+        ptrdiff_t index = static_cast<ptrdiff_t>(rank(node)) + offset;
+        map_node* root = root_of(node);
+        if (index < 0 || index >= static_cast<ptrdiff_t>(root->size)) {
+            return nullptr;
+        }
+        return select(root, static_cast<size_t>(index));
+    }
+    Link<map_node> left = nullptr;
+    Link<map_node> right = nullptr;
+    map_node* parent = nullptr;
+    // Moves with the node when split, join or extract_range hand it to another map.
+    node_owner<map_node>* owner = nullptr;
+    size_t size = 1;
+    // Live nodes are owned by the tree, ref_count counts the iterators. An erased node is unlinked from
+    // everything and lives on only while iterators point to it.
+    uint32_t ref_count = 0;
+    int8_t height = 1;
+    bool is_deleted = false;
+    V value;
+};
+
+// GCC 12 takes a node destroyed by the last release as used by the iterators whose copies and releases
+// are inlined next to it, erased nodes are only destroyed once nothing points to them.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuse-after-free"
+#endif
+template <class V, class Allocator, bool Threaded = false, template <class> class Link = plain_link>
+class node_pointer {
+public:
+    using node_type = map_node<V, Threaded, Link>;
+    using allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<node_type>;
+    using owner_type = node_owner<node_type>;
+    node_pointer() = default;
     node_pointer(std::nullptr_t) {}
+    node_pointer(node_type* node, owner_type* owner) : owned_node(node), owner(owner) {
+        if (owned_node != nullptr) {
+            owned_node->ref_count += 1;
+        }
+    }
     node_pointer& operator=(std::nullptr_t) {
         release();
         return *this;
     }
-    node_pointer(const node_pointer& other) : allocator(other.allocator) {
-        acquire(other);
+    node_pointer(const node_pointer& other) : node_pointer(other.owned_node, other.owner) {}
+    node_pointer(node_pointer&& other) noexcept : owned_node(other.owned_node), owner(other.owner) {
+        other.owned_node = nullptr;
+        other.owner = nullptr;
     }
     node_pointer& operator=(const node_pointer& other) {
         if (owned_node == other.owned_node) {
@@ -46,115 +233,130 @@ public:
         acquire(other);
         return *this;
     }
-    map_node* operator->() {
-        return owned_node;
-    }
-    bool operator==(node_pointer rhs) const {
-        return owned_node == rhs.owned_node;
-    }
-    bool operator!=(node_pointer rhs) const {
-        return owned_node != rhs.owned_node;
+    node_pointer& operator=(node_pointer&& other) noexcept {
+        if (this != &other) {
+            release();
+            owned_node = other.owned_node;
+            owner = other.owner;
+            other.owned_node = nullptr;
+            other.owner = nullptr;
+        }
+        return *this;
     }
     ~node_pointer() {
         release();
     }
-    void acquire(const node_pointer& other) {
-        allocator = other.allocator;
-        owned_node = other.owned_node;
-        if (owned_node != nullptr) {
-            owned_node->ref_count += 1;
-        }
+    node_type* operator->() const {
+        return owned_node;
     }
-    void release() {
-        if (owned_node != nullptr) {
-            owned_node->ref_count -= 1;
-            if (owned_node->ref_count == 0) {
-                destroy();
-            }
-            owned_node = nullptr;
-            allocator = nullptr;
-        }
+    node_type* get() const {
+        return owned_node;
     }
-    void destroy() {
-        std::allocator_traits<allocator_type>::destroy(*allocator, owned_node);
-        std::allocator_traits<allocator_type>::deallocate(*allocator, owned_node, 1);
+    bool operator==(const node_pointer& rhs) const {
+        return owned_node == rhs.owned_node;
+    }
+    bool operator!=(const node_pointer& rhs) const {
+        return owned_node != rhs.owned_node;
     }
-    void force_destroy() {
+    node_pointer prev() const {
         if (owned_node == nullptr) {
-            return;
-        }
-        if (owned_node->left != nullptr) {
-            owned_node->left.force_destroy();
+            return advance(-1);
         }
-        if (owned_node->right != nullptr) {
-            owned_node->right.force_destroy();
-        }
-        if (owned_node->left == nullptr && owned_node->right == nullptr) {
-            owned_node->parent = nullptr;
-            destroy();
-            owned_node = nullptr;
-            allocator = nullptr;
+        if (owned_node->is_deleted) {
+            return node_pointer(tree()->erased_step(owned_node, false), tree());
         }
+        return node_pointer(node_type::prev(owned_node), tree());
     }
-    node_pointer prev() {
+    node_pointer next() const {
         if (owned_node->is_deleted) {
-            return nearest_not_deleted();
+            return node_pointer(tree()->erased_step(owned_node, true), tree());
         }
-        if (owned_node->left != nullptr) {
-            return owned_node->left.max();
-        }
-        return nearest_right_ancestor();
+        return node_pointer(node_type::next(owned_node), tree());
     }
-    node_pointer next() {
-        if (owned_node->is_deleted) {
-           return nearest_not_deleted();
+    // Moves by offset positions in O(log n), an erased node first steps to the node ++ or -- would return and
+    // nullptr stands for the position past the last node.
+    node_pointer advance(ptrdiff_t offset) const {
+        node_type* node = owned_node;
+        if (node == nullptr) {
+            if (offset == 0) {
+                return *this;
+            }
+            if (owner == nullptr) {
+                throw std::out_of_range("Iterator does not belong to a map");
+            }
+            ptrdiff_t index = static_cast<ptrdiff_t>(owner->position(nullptr)) + offset;
+            return node_pointer(index < 0 ? nullptr : owner->node_at(static_cast<size_t>(index)), owner);
         }
-        if (owned_node->right != nullptr) {
-            return owned_node->right.min();
+        if (offset != 0 && node->is_deleted) {
+            node = tree()->erased_step(node, offset > 0);
+            offset += offset > 0 ? -1 : 1;
         }
-        return nearest_left_ancestor();
+        return node_pointer(node == nullptr ? nullptr : node_type::advance(node, offset), tree());
     }
-    node_pointer min() {
-        node_pointer node = *this;
-        while (node->left != nullptr) {
-            node = node->left;
+    // Returns the offset from this node to another, nullptr standing for the position past the last node.
+    ptrdiff_t distance(const node_pointer& to) const {
+        const owner_type* map = tree() != nullptr ? tree() : to.tree();
+        if (map == nullptr) {
+            return 0;
         }
-        return node;
+        return static_cast<ptrdiff_t>(map->position(to.owned_node)) -
+               static_cast<ptrdiff_t>(map->position(owned_node));
     }
-    node_pointer max() {
-        node_pointer node = *this;
-        while (node->right != nullptr) {
-            node = node->right;
+    void acquire(const node_pointer& other) {
+        owner = other.owner;
+        owned_node = other.owned_node;
+        if (owned_node != nullptr) {
+            owned_node->ref_count += 1;
         }
-        return node;
     }
-    node_pointer nearest_left_ancestor() {
-        node_pointer node = *this;
-        while (node != nullptr) {
-            if (node->parent != nullptr && node->parent->left == node) {
-                return node->parent;
+    void release() {
+        if (owned_node != nullptr) {
+            owned_node->ref_count -= 1;
+            if (owned_node->ref_count == 0 && owned_node->is_deleted) {
+                owned_node->owner->destroy_erased(owned_node);
             }
-            node = node->parent;
+            owned_node = nullptr;
+            owner = nullptr;
         }
-        return nullptr;
     }
-    node_pointer nearest_right_ancestor() {
-        node_pointer node = *this;
-        while (node != nullptr) {
-            if (node->parent != nullptr && node->parent->right == node) {
-                return node->parent;
-            }
-            node = node->parent;
+    template <class... Args>
+    static node_type* create(owner_type* owner, allocator_type& allocator, Args&&... args) {
+        node_type* node = std::allocator_traits<allocator_type>::allocate(allocator, 1);
+        try {
+            std::allocator_traits<allocator_type>::construct(allocator, node, std::forward<Args>(args)...);
+        } catch (...) {
+            std::allocator_traits<allocator_type>::deallocate(allocator, node, 1);
+            throw;
         }
-        return nullptr;
+        node->owner = owner;
+        return node;
     }
-    node_pointer nearest_not_deleted() {
-        node_pointer node = *this;
-        while (node != nullptr && node->is_deleted) {
-            node = node->parent;
+    static void destroy(allocator_type& allocator, node_type* node) {
+        std::allocator_traits<allocator_type>::destroy(allocator, node);
+        std::allocator_traits<allocator_type>::deallocate(allocator, node, 1);
+    }
+    // Unlinks an erased node, which is destroyed unless iterators still point to it.
+    static void retire(allocator_type& allocator, node_type* node) {
+        node->is_deleted = true;
+        node->left = nullptr;
+        node->right = nullptr;
+        node->parent = nullptr;
+        if constexpr (Threaded) {
+            node->successor = nullptr;
+            node->predecessor = nullptr;
         }
-        return node;
+        if (node->ref_count == 0) {
+            destroy(allocator, node);
+        }
+    }
+private:
+    // The map of the node, which moves with it between maps, or the map of end() for nullptr.
+    owner_type* tree() const {
+        return owned_node != nullptr ? owned_node->owner : owner;
     }
-    map_node* owned_node = nullptr;
-    allocator_type* allocator = nullptr;
-};
\ No newline at end of file
+    node_type* owned_node = nullptr;
+    owner_type* owner = nullptr;
+};
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 12
+#pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "fwd.hpp"
+
+#include <iterator>
+
+// Iterates the elements with keys in [lo, hi). The upper bound is checked by key on every step, so the
+// range stays bounded even if the element at hi is erased while iterating. Iterators refer to the range
+// they were obtained from and must not outlive it.
+template <class Map, class K>
+class map_range {
+private:
+    using base_iterator = typename Map::iterator;
+public:
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = typename Map::value_type;
+        using pointer = value_type*;
+        using reference = value_type&;
+        iterator() = default;
+        iterator& operator++() {
+            ++position;
+            if (position != range->last && !range->comparator(position->first, range->hi)) {
+                position = range->last;
+            }
+            return *this;
+        }
+        iterator operator++(int) {
+            iterator other = *this;
+            ++*this;
+            return other;
+        }
+        value_type& operator*() {
+            return *position;
+        }
+        value_type* operator->() {
+            return &*position;
+        }
+        bool operator==(const iterator& other) const {
+            return position == other.position;
+        }
+        bool operator!=(const iterator& other) const {
+            return position != other.position;
+        }
+        operator base_iterator() const {
+            return position;
+        }
+    private:
+        friend map_range;
+        iterator(base_iterator position, const map_range* range) : position(position), range(range) {}
+        base_iterator position;
+        const map_range* range = nullptr;
+    };
+    map_range(base_iterator first, base_iterator last, K hi, typename Map::key_compare comparator)
+        : first(first), last(last), hi(std::move(hi)), comparator(std::move(comparator)) {}
+    iterator begin() const {
+        return iterator(first, this);
+    }
+    iterator end() const {
+        return iterator(last, this);
+    }
+    bool empty() const {
+        return first == last;
+    }
+private:
+    base_iterator first;
+    base_iterator last;
+    K hi;
+    typename Map::key_compare comparator;
+};
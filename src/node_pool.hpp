@@ -0,0 +1,192 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+namespace polyndrom {
+
+// A slab allocator for the nodes of a map. Fixed 64 KiB slabs are carved into 16 byte size classes, each
+// with an intrusive free list that hands freed blocks out again right away, and all slabs are returned at
+// once when the map is done with them. A pool belongs to a map rather than to a thread and takes no locks,
+// since acid_map is single-threaded; reclamation that has to wait for concurrent readers is done in front
+// of it by concurrent_acid_map's epoch_allocator.
+class node_pool {
+public:
+    static constexpr size_t granularity = alignof(std::max_align_t);
+    static constexpr size_t max_block_size = 512;
+    static constexpr size_t slab_size = 64 * 1024;
+    node_pool() = default;
+    node_pool(const node_pool&) = delete;
+    node_pool& operator=(const node_pool&) = delete;
+    ~node_pool() {
+        release();
+    }
+    static constexpr bool is_pooled(size_t size, size_t alignment) {
+        return size <= max_block_size && alignment <= granularity;
+    }
+    void* allocate(size_t size, size_t alignment) {
+        if (!is_pooled(size, alignment)) {
+            void* block = ::operator new(size, std::align_val_t(alignment));
+            ++blocks_in_use;
+            return block;
+        }
+        size_class& cls = classes[class_index(size)];
+        void* block;
+        if (cls.free_list != nullptr) {
+            block = cls.free_list;
+            cls.free_list = cls.free_list->next;
+        } else {
+            size_t block_size = class_size(size);
+            if (cls.cursor == cls.end) {
+                grow(cls, block_size);
+            }
+            block = cls.cursor;
+            cls.cursor += block_size;
+        }
+        ++blocks_in_use;
+        return block;
+    }
+    void deallocate(void* block, size_t size, size_t alignment) noexcept {
+        --blocks_in_use;
+        if (!is_pooled(size, alignment)) {
+            ::operator delete(block, std::align_val_t(alignment));
+            return;
+        }
+        size_class& cls = classes[class_index(size)];
+        auto* freed = static_cast<free_block*>(block);
+        freed->next = cls.free_list;
+        cls.free_list = freed;
+    }
+    size_t in_use() const {
+        return blocks_in_use;
+    }
+    // Maps allocating from the pool. Copies of the allocator held elsewhere do not count, so a map alone on
+    // its pool releases it at once even while the allocator it was built from is still around, together
+    // with any block allocated through such a copy.
+    size_t attached_maps() const {
+        return maps;
+    }
+    void attach() noexcept {
+        ++maps;
+    }
+    void detach() noexcept {
+        --maps;
+    }
+    // Returns every slab at once, blocks that are still handed out become dangling.
+    void release() noexcept {
+        while (slabs != nullptr) {
+            slab* next = slabs->next;
+            ::operator delete(slabs);
+            slabs = next;
+        }
+        for (size_class& cls : classes) {
+            cls = size_class();
+        }
+        blocks_in_use = 0;
+    }
+private:
+    struct free_block {
+        free_block* next;
+    };
+    struct alignas(granularity) slab {
+        slab* next;
+    };
+    struct size_class {
+        free_block* free_list = nullptr;
+        std::byte* cursor = nullptr;
+        std::byte* end = nullptr;
+    };
+    static constexpr size_t class_index(size_t size) {
+        return size == 0 ? 0 : (size - 1) / granularity;
+    }
+    static constexpr size_t class_size(size_t size) {
+        return (class_index(size) + 1) * granularity;
+    }
+    void grow(size_class& cls, size_t block_size) {
+        auto* new_slab = static_cast<slab*>(::operator new(slab_size));
+        new_slab->next = slabs;
+        slabs = new_slab;
+        cls.cursor = reinterpret_cast<std::byte*>(new_slab) + sizeof(slab);
+        cls.end = cls.cursor + (slab_size - sizeof(slab)) / block_size * block_size;
+    }
+    slab* slabs = nullptr;
+    size_class classes[max_block_size / granularity];
+    size_t blocks_in_use = 0;
+    size_t maps = 0;
+};
+
+template <class T>
+class node_pool_allocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    static constexpr bool is_pooled = node_pool::is_pooled(sizeof(T), alignof(T));
+    node_pool_allocator() : pool(std::make_shared<node_pool>()) {}
+    template <class U>
+    node_pool_allocator(const node_pool_allocator<U>& other) noexcept : pool(other.pool) {}
+    T* allocate(size_t n) {
+        return static_cast<T*>(pool->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T* ptr, size_t n) noexcept {
+        pool->deallocate(ptr, n * sizeof(T), alignof(T));
+    }
+    size_t in_use() const {
+        return pool->in_use();
+    }
+    bool owns_pool() const {
+        return pool->attached_maps() == 1;
+    }
+    void attach() noexcept {
+        pool->attach();
+    }
+    void detach() noexcept {
+        pool->detach();
+    }
+    void release() {
+        pool->release();
+    }
+    template <class U>
+    bool operator==(const node_pool_allocator<U>& other) const {
+        return pool == other.pool;
+    }
+    template <class U>
+    bool operator!=(const node_pool_allocator<U>& other) const {
+        return pool != other.pool;
+    }
+private:
+    template <class U>
+    friend class node_pool_allocator;
+    std::shared_ptr<node_pool> pool;
+};
+
+template <class Allocator>
+struct is_node_pool_allocator : std::false_type {};
+
+template <class T>
+struct is_node_pool_allocator<node_pool_allocator<T>> : std::true_type {};
+
+// Keeps a map attached to the pool of its allocator for as long as the map lives.
+template <class Allocator>
+class pool_attachment {
+public:
+    explicit pool_attachment(Allocator& allocator) noexcept : allocator(allocator) {
+        if constexpr (is_node_pool_allocator<Allocator>::value) {
+            allocator.attach();
+        }
+    }
+    pool_attachment(const pool_attachment&) = delete;
+    pool_attachment& operator=(const pool_attachment&) = delete;
+    ~pool_attachment() {
+        if constexpr (is_node_pool_allocator<Allocator>::value) {
+            allocator.detach();
+        }
+    }
+private:
+    Allocator& allocator;
+};
+
+} // polyndrom
@@ -0,0 +1,627 @@
+#pragma once
+
+#include "buffer_pool.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace polyndrom {
+
+// An ordered map kept in a B+ tree on the pages of a file, with only as many pages in memory as the
+// buffer pool holds, so it can grow past the memory of the process. Keys and mapped values are copied
+// into pages byte for byte and have to be trivially copyable.
+//
+// Iterators remember the key they stand on. They are read only, dereference to a copy taken from the
+// page and stay usable across any modification: an iterator to an erased element keeps its value and
+// still moves to the neighbours of its key, as acid_map iterators do.
+//
+// Leaves are not merged when they shrink, the space of erased elements is reused by later inserts into
+// the same key range. The tree is written to the file on flush and on destruction; it is not crash safe
+// on its own.
+template <class Key, class T, class Compare = std::less<Key>>
+class paged_acid_map {
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<T>,
+                  "paged_acid_map stores keys and mapped values as raw bytes");
+    using page_id = buffer_pool::page_id;
+    using self_type = paged_acid_map<Key, T, Compare>;
+public:
+    using key_type = Key;
+    using mapped_type = T;
+    using value_type = std::pair<const Key, T>;
+    using size_type = std::size_t;
+    using key_compare = Compare;
+
+    class iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = std::pair<const Key, T>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+        iterator() = default;
+        iterator(const iterator&) = default;
+        iterator& operator=(const iterator& other) {
+            if (this != &other) {
+                map = other.map;
+                leaf = other.leaf;
+                slot = other.slot;
+                version = other.version;
+                detached = other.detached;
+                current.reset();
+                if (other.current) {
+                    current.emplace(*other.current);
+                }
+            }
+            return *this;
+        }
+        reference operator*() const {
+            refresh();
+            return *current;
+        }
+        pointer operator->() const {
+            return &**this;
+        }
+        iterator& operator++() {
+            refresh();
+            if (!detached) {
+                map->step_forward(leaf, slot);
+            }
+            load();
+            return *this;
+        }
+        iterator operator++(int) {
+            iterator result = *this;
+            ++*this;
+            return result;
+        }
+        iterator& operator--() {
+            refresh();
+            if (leaf == 0) {
+                map->last_position(leaf, slot);
+            } else {
+                map->step_backward(leaf, slot);
+            }
+            load();
+            return *this;
+        }
+        iterator operator--(int) {
+            iterator result = *this;
+            --*this;
+            return result;
+        }
+        bool operator==(const iterator& other) const {
+            refresh();
+            other.refresh();
+            return leaf == other.leaf && slot == other.slot && detached == other.detached;
+        }
+        bool operator!=(const iterator& other) const {
+            return !(*this == other);
+        }
+    private:
+        friend class paged_acid_map;
+        iterator(const self_type* map, page_id leaf, size_t slot) : map(map), leaf(leaf), slot(slot) {
+            load();
+        }
+        void load() {
+            version = map->version;
+            detached = false;
+            current.reset();
+            if (leaf != 0) {
+                buffer_pool::page page = map->pool.pin(leaf);
+                current.emplace(map->key_at(page.data(), slot), map->value_at(page.data(), slot));
+            }
+        }
+        // Finds the element again after the tree changed, or its successor when it was erased.
+        void refresh() const {
+            if (version == map->version || !current) {
+                return;
+            }
+            version = map->version;
+            map->seek(current->first, leaf, slot);
+            if (leaf != 0) {
+                buffer_pool::page page = map->pool.pin(leaf);
+                Key key = map->key_at(page.data(), slot);
+                detached = map->comparator(current->first, key);
+                if (!detached) {
+                    current.reset();
+                    current.emplace(key, map->value_at(page.data(), slot));
+                }
+            } else {
+                detached = true;
+            }
+        }
+        const self_type* map = nullptr;
+        mutable page_id leaf = 0;
+        mutable size_t slot = 0;
+        mutable uint64_t version = 0;
+        mutable bool detached = false;
+        mutable std::optional<value_type> current;
+    };
+
+    explicit paged_acid_map(const std::string& path, size_t pool_pages = 1024,
+                            const key_compare& comparator = key_compare(), size_t page_size = 4096)
+        : comparator(comparator), pool(path, page_size, pool_pages),
+          leaf_capacity((page_size - header_bytes) / (sizeof(Key) + sizeof(T))),
+          inner_capacity((page_size - header_bytes - sizeof(page_id)) / (sizeof(Key) + sizeof(page_id))) {
+        if (leaf_capacity < 3 || inner_capacity < 3) {
+            throw std::invalid_argument("Pages are too small for the key and mapped types");
+        }
+        if (pool_pages < 8) {
+            throw std::invalid_argument("The buffer pool needs at least 8 pages");
+        }
+        if (pool.pages() == 0) {
+            pool.allocate();
+            write_meta();
+        } else {
+            read_meta();
+        }
+    }
+    paged_acid_map(const paged_acid_map&) = delete;
+    paged_acid_map& operator=(const paged_acid_map&) = delete;
+    ~paged_acid_map() {
+        try {
+            write_meta();
+        } catch (...) {
+        }
+    }
+    std::pair<iterator, bool> insert(const value_type& value) {
+        return insert_value(value.first, value.second, false);
+    }
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        value_type value(std::forward<Args>(args)...);
+        return insert_value(value.first, value.second, false);
+    }
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(const key_type& key, Args&&... args) {
+        return insert_value(key, T(std::forward<Args>(args)...), false);
+    }
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(const key_type& key, M&& mapped) {
+        return insert_value(key, T(std::forward<M>(mapped)), true);
+    }
+    size_type erase(const key_type& key) {
+        if (root == 0) {
+            return 0;
+        }
+        buffer_pool::page page = descend(key);
+        node_header header = header_of(page.data());
+        size_t pos = lower(page.data(), header.count, key);
+        if (pos == header.count || comparator(key, key_at(page.data(), pos))) {
+            return 0;
+        }
+        char* data = page.mutable_data();
+        move_entries(data, pos + 1, pos, header.count - pos - 1);
+        --header.count;
+        set_header(data, header);
+        --map_size;
+        ++version;
+        return 1;
+    }
+    // Returns the iterator following the erased element.
+    iterator erase(iterator it) {
+        key_type key = it->first;
+        erase(key);
+        return ++it;
+    }
+    iterator find(const key_type& key) const {
+        iterator it = lower_bound(key);
+        if (it == end() || comparator(key, it->first)) {
+            return end();
+        }
+        return it;
+    }
+    iterator lower_bound(const key_type& key) const {
+        page_id leaf;
+        size_t slot;
+        seek(key, leaf, slot);
+        return iterator(this, leaf, slot);
+    }
+    iterator upper_bound(const key_type& key) const {
+        iterator it = lower_bound(key);
+        if (it != end() && !comparator(key, it->first)) {
+            ++it;
+        }
+        return it;
+    }
+    bool contains(const key_type& key) const {
+        return find(key) != end();
+    }
+    size_type count(const key_type& key) const {
+        return contains(key) ? 1 : 0;
+    }
+    iterator begin() const {
+        if (root == 0) {
+            return end();
+        }
+        page_id id = root;
+        while (true) {
+            buffer_pool::page page = pool.pin(id);
+            if (header_of(page.data()).kind == leaf_kind) {
+                break;
+            }
+            id = child_at(page.data(), 0);
+        }
+        size_t slot = 0;
+        skip_empty_forward(id, slot);
+        return iterator(this, id, slot);
+    }
+    iterator end() const {
+        return iterator(this, 0, 0);
+    }
+    size_type size() const {
+        return map_size;
+    }
+    bool empty() const {
+        return map_size == 0;
+    }
+    // Drops every element and gives the pages of the file back.
+    void clear() {
+        pool.reset();
+        root = 0;
+        map_size = 0;
+        ++version;
+        pool.allocate();
+        write_meta();
+    }
+    // Writes every changed page to the file and syncs it.
+    void flush() {
+        write_meta();
+        pool.flush();
+    }
+    key_compare key_comp() const {
+        return comparator;
+    }
+    const buffer_pool& pages() const {
+        return pool;
+    }
+private:
+    static constexpr uint32_t leaf_kind = 1;
+    static constexpr uint32_t inner_kind = 2;
+    static constexpr char magic[8] = {'A', 'C', 'I', 'D', 'P', 'A', 'G', 'E'};
+    static constexpr uint32_t format_version = 1;
+    // Every node page starts with its kind, its number of keys and, for leaves, the neighbouring leaves.
+    struct node_header {
+        uint32_t kind;
+        uint32_t count;
+        page_id prev;
+        page_id next;
+    };
+    struct meta {
+        char magic[8];
+        uint32_t version;
+        uint32_t page_size;
+        uint32_t key_size;
+        uint32_t mapped_size;
+        page_id root;
+        uint64_t size;
+    };
+    struct split_result {
+        Key separator;
+        page_id right;
+    };
+    static constexpr size_t header_bytes = sizeof(node_header);
+
+    static node_header header_of(const char* data) {
+        node_header header;
+        std::memcpy(&header, data, sizeof(header));
+        return header;
+    }
+    static void set_header(char* data, const node_header& header) {
+        std::memcpy(data, &header, sizeof(header));
+    }
+    Key key_at(const char* data, size_t i) const {
+        Key key;
+        std::memcpy(&key, data + header_bytes + i * sizeof(Key), sizeof(Key));
+        return key;
+    }
+    void set_key(char* data, size_t i, const Key& key) const {
+        std::memcpy(data + header_bytes + i * sizeof(Key), &key, sizeof(Key));
+    }
+    size_t values_offset() const {
+        return header_bytes + leaf_capacity * sizeof(Key);
+    }
+    T value_at(const char* data, size_t i) const {
+        T value;
+        std::memcpy(&value, data + values_offset() + i * sizeof(T), sizeof(T));
+        return value;
+    }
+    void set_value(char* data, size_t i, const T& value) const {
+        std::memcpy(data + values_offset() + i * sizeof(T), &value, sizeof(T));
+    }
+    size_t children_offset() const {
+        return header_bytes + inner_capacity * sizeof(Key);
+    }
+    page_id child_at(const char* data, size_t i) const {
+        page_id child;
+        std::memcpy(&child, data + children_offset() + i * sizeof(page_id), sizeof(page_id));
+        return child;
+    }
+    void set_child(char* data, size_t i, page_id child) const {
+        std::memcpy(data + children_offset() + i * sizeof(page_id), &child, sizeof(page_id));
+    }
+    // Moves count leaf entries, or inner keys, from position from to position to of the same page.
+    void move_entries(char* data, size_t from, size_t to, size_t count) const {
+        std::memmove(data + header_bytes + to * sizeof(Key), data + header_bytes + from * sizeof(Key),
+                     count * sizeof(Key));
+        if (header_of(data).kind == leaf_kind) {
+            std::memmove(data + values_offset() + to * sizeof(T), data + values_offset() + from * sizeof(T),
+                         count * sizeof(T));
+        }
+    }
+    void move_children(char* data, size_t from, size_t to, size_t count) const {
+        std::memmove(data + children_offset() + to * sizeof(page_id), data + children_offset() + from * sizeof(page_id),
+                     count * sizeof(page_id));
+    }
+    // The first position whose key is not less than key.
+    size_t lower(const char* data, size_t count, const Key& key) const {
+        size_t lo = 0;
+        size_t hi = count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (comparator(key_at(data, mid), key)) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+    // The child of an inner node that covers key: the number of separators not greater than key.
+    size_t child_index(const char* data, size_t count, const Key& key) const {
+        size_t lo = 0;
+        size_t hi = count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (comparator(key, key_at(data, mid))) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        return lo;
+    }
+    buffer_pool::page descend(const Key& key) const {
+        buffer_pool::page page = pool.pin(root);
+        while (true) {
+            node_header header = header_of(page.data());
+            if (header.kind == leaf_kind) {
+                return page;
+            }
+            page = pool.pin(child_at(page.data(), child_index(page.data(), header.count, key)));
+        }
+    }
+    // Positions leaf and slot at the first element not less than key, leaf is 0 past the last element.
+    void seek(const Key& key, page_id& leaf, size_t& slot) const {
+        if (root == 0) {
+            leaf = 0;
+            slot = 0;
+            return;
+        }
+        buffer_pool::page page = descend(key);
+        leaf = page.id();
+        slot = lower(page.data(), header_of(page.data()).count, key);
+        skip_empty_forward(leaf, slot);
+    }
+    void skip_empty_forward(page_id& leaf, size_t& slot) const {
+        while (leaf != 0) {
+            buffer_pool::page page = pool.pin(leaf);
+            node_header header = header_of(page.data());
+            if (slot < header.count) {
+                return;
+            }
+            leaf = header.next;
+            slot = 0;
+        }
+        slot = 0;
+    }
+    void step_forward(page_id& leaf, size_t& slot) const {
+        ++slot;
+        skip_empty_forward(leaf, slot);
+    }
+    void step_backward(page_id& leaf, size_t& slot) const {
+        while (slot == 0) {
+            buffer_pool::page page = pool.pin(leaf);
+            leaf = header_of(page.data()).prev;
+            if (leaf == 0) {
+                return;
+            }
+            buffer_pool::page previous = pool.pin(leaf);
+            slot = header_of(previous.data()).count;
+        }
+        --slot;
+    }
+    void last_position(page_id& leaf, size_t& slot) const {
+        leaf = 0;
+        slot = 0;
+        if (root == 0) {
+            return;
+        }
+        page_id id = root;
+        while (true) {
+            buffer_pool::page page = pool.pin(id);
+            node_header header = header_of(page.data());
+            if (header.kind == leaf_kind) {
+                break;
+            }
+            id = child_at(page.data(), header.count);
+        }
+        leaf = id;
+        buffer_pool::page page = pool.pin(leaf);
+        slot = header_of(page.data()).count;
+        step_backward(leaf, slot);
+    }
+    std::pair<iterator, bool> insert_value(const Key& key, const T& value, bool assign) {
+        if (root == 0) {
+            buffer_pool::page page = pool.allocate();
+            set_header(page.mutable_data(), node_header{leaf_kind, 0, 0, 0});
+            root = page.id();
+        }
+        bool inserted = false;
+        page_id leaf = 0;
+        size_t slot = 0;
+        std::optional<split_result> split = insert_at(root, key, value, assign, inserted, leaf, slot);
+        if (split) {
+            buffer_pool::page page = pool.allocate();
+            char* data = page.mutable_data();
+            set_header(data, node_header{inner_kind, 1, 0, 0});
+            set_key(data, 0, split->separator);
+            set_child(data, 0, root);
+            set_child(data, 1, split->right);
+            root = page.id();
+        }
+        if (inserted) {
+            ++map_size;
+        }
+        if (inserted || assign) {
+            ++version;
+        }
+        return {iterator(this, leaf, slot), inserted};
+    }
+    std::optional<split_result> insert_at(page_id id, const Key& key, const T& value, bool assign, bool& inserted,
+                                          page_id& leaf, size_t& slot) {
+        size_t index;
+        page_id child;
+        {
+            buffer_pool::page page = pool.pin(id);
+            node_header header = header_of(page.data());
+            if (header.kind == leaf_kind) {
+                return insert_into_leaf(page, key, value, assign, inserted, leaf, slot);
+            }
+            index = child_index(page.data(), header.count, key);
+            child = child_at(page.data(), index);
+        }
+        std::optional<split_result> split = insert_at(child, key, value, assign, inserted, leaf, slot);
+        if (!split) {
+            return std::nullopt;
+        }
+        buffer_pool::page page = pool.pin(id);
+        node_header header = header_of(page.data());
+        if (header.count < inner_capacity) {
+            insert_into_inner(page.mutable_data(), index, *split);
+            return std::nullopt;
+        }
+        buffer_pool::page right = pool.allocate();
+        char* left_data = page.mutable_data();
+        char* right_data = right.mutable_data();
+        size_t mid = header.count / 2;
+        split_result promoted{key_at(left_data, mid), right.id()};
+        size_t moved = header.count - mid - 1;
+        set_header(right_data, node_header{inner_kind, static_cast<uint32_t>(moved), 0, 0});
+        std::memcpy(right_data + header_bytes, left_data + header_bytes + (mid + 1) * sizeof(Key), moved * sizeof(Key));
+        std::memcpy(right_data + children_offset(), left_data + children_offset() + (mid + 1) * sizeof(page_id),
+                    (moved + 1) * sizeof(page_id));
+        header.count = static_cast<uint32_t>(mid);
+        set_header(left_data, header);
+        if (index <= mid) {
+            insert_into_inner(left_data, index, *split);
+        } else {
+            insert_into_inner(right_data, index - mid - 1, *split);
+        }
+        return promoted;
+    }
+    void insert_into_inner(char* data, size_t index, const split_result& split) const {
+        node_header header = header_of(data);
+        move_entries(data, index, index + 1, header.count - index);
+        move_children(data, index + 1, index + 2, header.count - index);
+        set_key(data, index, split.separator);
+        set_child(data, index + 1, split.right);
+        ++header.count;
+        set_header(data, header);
+    }
+    std::optional<split_result> insert_into_leaf(buffer_pool::page& page, const Key& key, const T& value, bool assign,
+                                                 bool& inserted, page_id& leaf, size_t& slot) {
+        node_header header = header_of(page.data());
+        size_t pos = lower(page.data(), header.count, key);
+        leaf = page.id();
+        slot = pos;
+        if (pos < header.count && !comparator(key, key_at(page.data(), pos))) {
+            if (assign) {
+                set_value(page.mutable_data(), pos, value);
+            }
+            return std::nullopt;
+        }
+        inserted = true;
+        if (header.count < leaf_capacity) {
+            insert_into_leaf(page.mutable_data(), pos, key, value);
+            return std::nullopt;
+        }
+        buffer_pool::page right = pool.allocate();
+        char* left_data = page.mutable_data();
+        char* right_data = right.mutable_data();
+        size_t mid = header.count / 2;
+        size_t moved = header.count - mid;
+        set_header(right_data, node_header{leaf_kind, static_cast<uint32_t>(moved), page.id(), header.next});
+        std::memcpy(right_data + header_bytes, left_data + header_bytes + mid * sizeof(Key), moved * sizeof(Key));
+        std::memcpy(right_data + values_offset(), left_data + values_offset() + mid * sizeof(T), moved * sizeof(T));
+        if (header.next != 0) {
+            buffer_pool::page next = pool.pin(header.next);
+            char* next_data = next.mutable_data();
+            node_header next_header = header_of(next_data);
+            next_header.prev = right.id();
+            set_header(next_data, next_header);
+        }
+        header.count = static_cast<uint32_t>(mid);
+        header.next = right.id();
+        set_header(left_data, header);
+        if (pos <= mid) {
+            insert_into_leaf(left_data, pos, key, value);
+        } else {
+            insert_into_leaf(right_data, pos - mid, key, value);
+            leaf = right.id();
+            slot = pos - mid;
+        }
+        return split_result{key_at(right_data, 0), right.id()};
+    }
+    void insert_into_leaf(char* data, size_t pos, const Key& key, const T& value) const {
+        node_header header = header_of(data);
+        move_entries(data, pos, pos + 1, header.count - pos);
+        set_key(data, pos, key);
+        set_value(data, pos, value);
+        ++header.count;
+        set_header(data, header);
+    }
+    void write_meta() {
+        meta m{};
+        std::memcpy(m.magic, magic, sizeof(magic));
+        m.version = format_version;
+        m.page_size = static_cast<uint32_t>(pool.page_bytes());
+        m.key_size = sizeof(Key);
+        m.mapped_size = sizeof(T);
+        m.root = root;
+        m.size = map_size;
+        buffer_pool::page page = pool.pin(0);
+        std::memcpy(page.mutable_data(), &m, sizeof(m));
+    }
+    void read_meta() {
+        meta m;
+        {
+            buffer_pool::page page = pool.pin(0);
+            std::memcpy(&m, page.data(), sizeof(m));
+        }
+        if (std::memcmp(m.magic, magic, sizeof(magic)) != 0 || m.version != format_version) {
+            throw std::runtime_error("Not a paged_acid_map file");
+        }
+        if (m.page_size != pool.page_bytes() || m.key_size != sizeof(Key) || m.mapped_size != sizeof(T)) {
+            throw std::runtime_error("Paged file holds different page, key or mapped sizes");
+        }
+        root = m.root;
+        map_size = m.size;
+    }
+    key_compare comparator;
+    mutable buffer_pool pool;
+    size_t leaf_capacity;
+    size_t inner_capacity;
+    page_id root = 0;
+    size_type map_size = 0;
+    uint64_t version = 0;
+};
+
+} // polyndrom
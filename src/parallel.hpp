@@ -0,0 +1,141 @@
+#pragma once
+
+#include "work_stealing_pool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace polyndrom {
+
+// The pool parallel_for_each() and parallel_reduce() use unless given one, sized to the hardware.
+inline work_stealing_pool& default_pool() {
+    static work_stealing_pool pool;
+    return pool;
+}
+
+// Walks the subtrees of a map directly: iterators update the non-atomic reference counts of their nodes,
+// so they cannot be shared between threads. Subtrees smaller than grain are walked on one thread.
+template <class Map>
+class parallel_traversal {
+public:
+    static constexpr size_t grain = 4096;
+    template <class F>
+    static void for_each(Map& map, F& f, work_stealing_pool& pool) {
+        pool.run([&] {
+            for_each_subtree(map.root, f, pool);
+        });
+    }
+    template <class R, class Reduce, class Transform>
+    static std::optional<R> transform_reduce(Map& map, Reduce& reduce, Transform& transform,
+                                             work_stealing_pool& pool) {
+        std::optional<R> result;
+        pool.run([&] {
+            result = reduce_subtree<R>(map.root, reduce, transform, pool);
+        });
+        return result;
+    }
+private:
+    using node_type = typename Map::node_type;
+    template <class F>
+    static void for_each_serial(node_type* node, F& f) {
+        while (node != nullptr) {
+            for_each_serial(node->left, f);
+            f(node->value);
+            node = node->right;
+        }
+    }
+    template <class F>
+    static void for_each_subtree(node_type* node, F& f, work_stealing_pool& pool) {
+        if (node_type::subtree_size(node) < grain) {
+            for_each_serial(node, f);
+            return;
+        }
+        pool.fork_join([&] {
+            for_each_subtree(node->left, f, pool);
+        }, [&] {
+            f(node->value);
+            for_each_subtree(node->right, f, pool);
+        });
+    }
+    template <class R, class Reduce>
+    static void append(std::optional<R>& result, R&& value, Reduce& reduce) {
+        if (result.has_value()) {
+            result = reduce(std::move(*result), std::move(value));
+        } else {
+            result.emplace(std::move(value));
+        }
+    }
+    template <class R, class Reduce, class Transform>
+    static void reduce_serial(node_type* node, std::optional<R>& result, Reduce& reduce, Transform& transform) {
+        while (node != nullptr) {
+            reduce_serial(node->left, result, reduce, transform);
+            append(result, R(transform(node->value)), reduce);
+            node = node->right;
+        }
+    }
+    template <class R, class Reduce, class Transform>
+    static std::optional<R> reduce_subtree(node_type* node, Reduce& reduce, Transform& transform,
+                                           work_stealing_pool& pool) {
+        std::optional<R> left;
+        if (node_type::subtree_size(node) < grain) {
+            reduce_serial(node, left, reduce, transform);
+            return left;
+        }
+        std::optional<R> right;
+        pool.fork_join([&] {
+            left = reduce_subtree<R>(node->left, reduce, transform, pool);
+        }, [&] {
+            right.emplace(transform(node->value));
+            std::optional<R> rest = reduce_subtree<R>(node->right, reduce, transform, pool);
+            if (rest.has_value()) {
+                right = reduce(std::move(*right), std::move(*rest));
+            }
+        });
+        append(left, std::move(*right), reduce);
+        return left;
+    }
+};
+
+// Calls f on every element of the map, concurrently from the threads of the pool and in no particular
+// order. The map must not be modified meanwhile, f may modify the mapped values.
+template <class Map, class F>
+void parallel_for_each(Map& map, F f, work_stealing_pool& pool = default_pool()) {
+    parallel_traversal<Map>::for_each(map, f, pool);
+}
+
+// Returns reduce(init, transform(e1), ..., transform(en)) over the elements in key order, the partial
+// results of subtrees are combined concurrently, so reduce has to be associative but not commutative.
+template <class Map, class R, class Reduce, class Transform>
+R parallel_reduce(Map& map, R init, Reduce reduce, Transform transform, work_stealing_pool& pool = default_pool()) {
+    std::optional<R> result = parallel_traversal<Map>::template transform_reduce<R>(map, reduce, transform, pool);
+    if (!result.has_value()) {
+        return init;
+    }
+    return reduce(std::move(init), std::move(*result));
+}
+
+// Splits [first, last) into chunks ranges whose sizes differ by at most one, returned as chunks + 1
+// boundaries. Finding the boundaries takes O(chunks * log n). The iterators are not thread-safe, a
+// thread working on a chunk should take its own copies before the others start.
+template <class Map>
+std::vector<typename Map::iterator> split_range(Map& map, typename Map::iterator first, typename Map::iterator last,
+                                                size_t chunks) {
+    if (chunks == 0) {
+        chunks = 1;
+    }
+    size_t lo = map.rank(first);
+    size_t hi = std::max(map.rank(last), lo);
+    std::vector<typename Map::iterator> bounds;
+    bounds.reserve(chunks + 1);
+    bounds.push_back(first);
+    for (size_t i = 1; i < chunks; i++) {
+        bounds.push_back(map.nth(lo + (hi - lo) * i / chunks));
+    }
+    bounds.push_back(last);
+    return bounds;
+}
+
+} // polyndrom
@@ -0,0 +1,512 @@
+#pragma once
+
+#include "key_compare.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace polyndrom {
+
+// An ordered map whose versions share structure. snapshot() and copying are O(1): they only take a reference
+// to the current root. A write copies the nodes on its path that are shared with a snapshot and modifies
+// the nodes only this map refers to in place, so without snapshots it behaves like a plain AVL tree.
+// Nodes are reference counted and freed when the last version using them is dropped.
+// Iterators pin the version they started from and never see later writes. Elements are read only,
+// use insert_or_assign to change a mapped value. A snapshot may be read on any thread while the map
+// is being written on another one, as long as the allocator is thread safe.
+template <class Key, class T, class Compare = std::less<Key>, class Allocator = std::allocator<std::pair<const Key, T>>>
+class persistent_acid_map {
+private:
+    struct node {
+        template <class... Args>
+        node(Args&&... args) : value(std::forward<Args>(args)...) {}
+        const Key& key() const {
+            return value.first;
+        }
+        node* left = nullptr;
+        node* right = nullptr;
+        std::atomic<uint32_t> ref_count{1};
+        int8_t height = 1;
+        std::pair<const Key, T> value;
+    };
+    using node_allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<node>;
+    using node_traits = std::allocator_traits<node_allocator_type>;
+    // A counted reference to the root of one version together with the allocator its nodes come from.
+    class version {
+    public:
+        explicit version(const node_allocator_type& allocator) : allocator(allocator) {}
+        version(const version& other) : root(other.root), size(other.size), allocator(other.allocator) {
+            acquire(root);
+        }
+        version& operator=(const version& other) {
+            version copy(other);
+            std::swap(root, copy.root);
+            std::swap(size, copy.size);
+            std::swap(allocator, copy.allocator);
+            return *this;
+        }
+        ~version() {
+            release(allocator, root);
+        }
+        node* root = nullptr;
+        std::size_t size = 0;
+        node_allocator_type allocator;
+    };
+public:
+    using key_type = Key;
+    using mapped_type = T;
+    using value_type = std::pair<const Key, T>;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using key_compare = Compare;
+    using allocator_type = Allocator;
+    using reference = const value_type&;
+    using const_reference = const value_type&;
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = typename persistent_acid_map::value_type;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+        const_iterator() = default;
+        const_iterator& operator++() {
+            node* current = path.back();
+            path.pop_back();
+            for (node* child = current->right; child != nullptr; child = child->left) {
+                path.push_back(child);
+            }
+            return *this;
+        }
+        const_iterator operator++(int) {
+            const_iterator other = *this;
+            ++*this;
+            return other;
+        }
+        const value_type& operator*() const {
+            return path.back()->value;
+        }
+        const value_type* operator->() const {
+            return &path.back()->value;
+        }
+        bool operator==(const const_iterator& other) const {
+            return current() == other.current();
+        }
+        bool operator!=(const const_iterator& other) const {
+            return current() != other.current();
+        }
+    private:
+        friend persistent_acid_map;
+        explicit const_iterator(const version& pinned) : pinned(pinned) {
+            path.reserve(height(pinned.root));
+        }
+        node* current() const {
+            return path.empty() ? nullptr : path.back();
+        }
+        // The nodes still to be visited: the current one on top, below it every ancestor whose left
+        // subtree holds the current node.
+        std::optional<version> pinned;
+        std::vector<node*> path;
+    };
+    using iterator = const_iterator;
+    // An immutable view of the map at the moment it was taken.
+    class snapshot_type {
+    public:
+        const_iterator begin() const {
+            return persistent_acid_map::begin(tree);
+        }
+        const_iterator end() const {
+            return const_iterator();
+        }
+        template <class K>
+        const_iterator find(const K& key) const {
+            return persistent_acid_map::find(tree, comparator, key);
+        }
+        template <class K>
+        const_iterator lower_bound(const K& key) const {
+            return persistent_acid_map::lower_bound(tree, comparator, key);
+        }
+        template <class K>
+        bool contains(const K& key) const {
+            return find_node(tree.root, comparator, key) != nullptr;
+        }
+        template <class K>
+        size_type count(const K& key) const {
+            return contains(key) ? 1 : 0;
+        }
+        size_type size() const {
+            return tree.size;
+        }
+        bool empty() const {
+            return tree.size == 0;
+        }
+    private:
+        friend persistent_acid_map;
+        snapshot_type(const version& tree, const key_compare& comparator) : tree(tree), comparator(comparator) {}
+        version tree;
+        key_compare comparator;
+    };
+    persistent_acid_map(const allocator_type& allocator = allocator_type()) : tree(node_allocator_type(allocator)) {}
+    explicit persistent_acid_map(const key_compare& comparator, const allocator_type& allocator = allocator_type())
+        : tree(node_allocator_type(allocator)), comparator(comparator) {}
+    // Starts a new map sharing every node with the snapshot.
+    explicit persistent_acid_map(const snapshot_type& snapshot) : tree(snapshot.tree), comparator(snapshot.comparator) {}
+    persistent_acid_map(const persistent_acid_map& other) = default;
+    persistent_acid_map& operator=(const persistent_acid_map& other) = default;
+    snapshot_type snapshot() const {
+        return snapshot_type(tree, comparator);
+    }
+    template <class V>
+    std::pair<const_iterator, bool> insert(V&& value) {
+        return emplace(std::forward<V>(value));
+    }
+    template <class... Args>
+    std::pair<const_iterator, bool> emplace(Args&&... args) {
+        if constexpr (is_key_extractable<key_type, std::decay_t<Args>...>::value) {
+            return emplace_unique(extract_key<key_type>(args...), [&] {
+                return create(std::forward<Args>(args)...);
+            });
+        } else {
+            node* fresh = create(std::forward<Args>(args)...);
+            auto result = emplace_unique(fresh->key(), [fresh] {
+                return fresh;
+            });
+            if (!result.second) {
+                release(tree.allocator, fresh);
+            }
+            return result;
+        }
+    }
+    template <class... Args>
+    std::pair<const_iterator, bool> try_emplace(const key_type& key, Args&&... args) {
+        return emplace_unique(key, [&] {
+            return create(std::piecewise_construct, std::forward_as_tuple(key),
+                          std::forward_as_tuple(std::forward<Args>(args)...));
+        });
+    }
+    template <class M>
+    std::pair<const_iterator, bool> insert_or_assign(const key_type& key, M&& mapped) {
+        path_turns turns;
+        size_t depth = 0;
+        if (lookup(key, turns, depth)) {
+            assign_along(turns, depth, std::forward<M>(mapped));
+            return std::make_pair(path_to(turns, depth), false);
+        }
+        return insert_along(turns, create(std::piecewise_construct, std::forward_as_tuple(key),
+                                          std::forward_as_tuple(std::forward<M>(mapped))));
+    }
+    template <class K>
+    size_type erase(const K& key) {
+        if (find_node(tree.root, comparator, key) == nullptr) {
+            return 0;
+        }
+        erase_at(tree.root, key);
+        --tree.size;
+        return 1;
+    }
+    template <class K>
+    const_iterator find(const K& key) const {
+        return find(tree, comparator, key);
+    }
+    template <class K>
+    const_iterator lower_bound(const K& key) const {
+        return lower_bound(tree, comparator, key);
+    }
+    template <class K>
+    bool contains(const K& key) const {
+        return find_node(tree.root, comparator, key) != nullptr;
+    }
+    template <class K>
+    size_type count(const K& key) const {
+        return contains(key) ? 1 : 0;
+    }
+    const_iterator begin() const {
+        return begin(tree);
+    }
+    const_iterator end() const {
+        return const_iterator();
+    }
+    size_type size() const {
+        return tree.size;
+    }
+    bool empty() const {
+        return tree.size == 0;
+    }
+    void clear() {
+        tree = version(tree.allocator);
+    }
+    key_compare key_comp() const {
+        return comparator;
+    }
+private:
+    // Node heights are int8_t, so no path is longer than this.
+    static constexpr size_t max_height = 128;
+    // The turns from the root down to a node, set for right.
+    using path_turns = std::bitset<max_height>;
+    template <class K1, class K2>
+    static int compare(const key_compare& comparator, const K1& lhs, const K2& rhs) {
+        return three_way_compare<key_type>(comparator, lhs, rhs);
+    }
+    template <class K>
+    static node* find_node(node* root, const key_compare& comparator, const K& key) {
+        node* current = root;
+        while (current != nullptr) {
+            int cmp = compare(comparator, key, current->key());
+            if (cmp < 0) {
+                current = current->left;
+            } else if (cmp > 0) {
+                current = current->right;
+            } else {
+                break;
+            }
+        }
+        return current;
+    }
+    static const_iterator begin(const version& tree) {
+        const_iterator it(tree);
+        for (node* current = tree.root; current != nullptr; current = current->left) {
+            it.path.push_back(current);
+        }
+        return it;
+    }
+    template <class K>
+    static const_iterator find(const version& tree, const key_compare& comparator, const K& key) {
+        const_iterator it(tree);
+        for (node* current = tree.root; current != nullptr;) {
+            int cmp = compare(comparator, key, current->key());
+            if (cmp > 0) {
+                current = current->right;
+                continue;
+            }
+            it.path.push_back(current);
+            if (cmp == 0) {
+                return it;
+            }
+            current = current->left;
+        }
+        return const_iterator();
+    }
+    template <class K>
+    static const_iterator lower_bound(const version& tree, const key_compare& comparator, const K& key) {
+        const_iterator it(tree);
+        for (node* current = tree.root; current != nullptr;) {
+            if (comparator(current->key(), key)) {
+                current = current->right;
+            } else {
+                it.path.push_back(current);
+                current = current->left;
+            }
+        }
+        if (it.path.empty()) {
+            return const_iterator();
+        }
+        return it;
+    }
+    // Looks key up once and records the turns to it, or to the empty link where it belongs.
+    template <class K>
+    bool lookup(const K& key, path_turns& turns, size_t& depth) const {
+        for (node* current = tree.root; current != nullptr; depth++) {
+            int cmp = compare(comparator, key, current->key());
+            if (cmp == 0) {
+                return true;
+            }
+            turns[depth] = cmp > 0;
+            current = cmp > 0 ? current->right : current->left;
+        }
+        return false;
+    }
+    // Follows recorded turns, which stay valid until the tree is next written.
+    const_iterator path_to(const path_turns& turns, size_t depth) const {
+        const_iterator it(tree);
+        node* current = tree.root;
+        for (size_t i = 0; i < depth; i++) {
+            if (!turns[i]) {
+                it.path.push_back(current);
+            }
+            current = turns[i] ? current->right : current->left;
+        }
+        it.path.push_back(current);
+        return it;
+    }
+    // Inserts the node make returns unless key is present, allocating only after the lookup. The insert
+    // follows the turns of the lookup instead of comparing again; the returned iterator is found anew,
+    // as the rebalancing may have moved the new node.
+    template <class K, class Make>
+    std::pair<const_iterator, bool> emplace_unique(const K& key, Make make) {
+        path_turns turns;
+        size_t depth = 0;
+        if (lookup(key, turns, depth)) {
+            return std::make_pair(path_to(turns, depth), false);
+        }
+        return insert_along(turns, make());
+    }
+    std::pair<const_iterator, bool> insert_along(const path_turns& turns, node* fresh) {
+        insert_at(tree.root, fresh, turns, 0);
+        ++tree.size;
+        return std::make_pair(find(fresh->key()), true);
+    }
+    template <class... Args>
+    node* create(Args&&... args) {
+        node* result = node_traits::allocate(tree.allocator, 1);
+        try {
+            node_traits::construct(tree.allocator, result, std::forward<Args>(args)...);
+        } catch (...) {
+            node_traits::deallocate(tree.allocator, result, 1);
+            throw;
+        }
+        return result;
+    }
+    static void acquire(node* target) {
+        if (target != nullptr) {
+            target->ref_count.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    static void release(node_allocator_type& allocator, node* target) {
+        while (target != nullptr && target->ref_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            release(allocator, target->left);
+            node* right = target->right;
+            node_traits::destroy(allocator, target);
+            node_traits::deallocate(allocator, target, 1);
+            target = right;
+        }
+    }
+    // Makes the node behind link private to this version, copying it if a snapshot shares it.
+    // The copy takes a reference to both children, so they are copied in turn when a write reaches them.
+    void own(node*& link) {
+        node* shared = link;
+        if (shared->ref_count.load(std::memory_order_acquire) == 1) {
+            return;
+        }
+        node* copy = create(shared->value);
+        copy->left = shared->left;
+        copy->right = shared->right;
+        copy->height = shared->height;
+        acquire(copy->left);
+        acquire(copy->right);
+        link = copy;
+        release(tree.allocator, shared);
+    }
+    void insert_at(node*& link, node* fresh, const path_turns& turns, size_t depth) {
+        if (link == nullptr) {
+            link = fresh;
+            return;
+        }
+        own(link);
+        insert_at(turns[depth] ? link->right : link->left, fresh, turns, depth + 1);
+        rebalance(link);
+    }
+    template <class M>
+    void assign_along(const path_turns& turns, size_t depth, M&& mapped) {
+        node** link = &tree.root;
+        for (size_t i = 0; i < depth; i++) {
+            own(*link);
+            link = turns[i] ? &(*link)->right : &(*link)->left;
+        }
+        own(*link);
+        (*link)->value.second = std::forward<M>(mapped);
+    }
+    template <class K>
+    void erase_at(node*& link, const K& key) {
+        own(link);
+        int cmp = compare(comparator, key, link->key());
+        if (cmp < 0) {
+            erase_at(link->left, key);
+        } else if (cmp > 0) {
+            erase_at(link->right, key);
+        } else {
+            node* erased = link;
+            bool spliced = erased->left == nullptr || erased->right == nullptr;
+            if (spliced) {
+                link = erased->left != nullptr ? erased->left : erased->right;
+            } else {
+                node* replacement = extract_min(erased->right);
+                replacement->left = erased->left;
+                replacement->right = erased->right;
+                link = replacement;
+            }
+            erased->left = nullptr;
+            erased->right = nullptr;
+            release(tree.allocator, erased);
+            // A spliced in child was never copied and may be shared with snapshots. Its subtree is
+            // unchanged and already balanced, so it is left untouched.
+            if (spliced) {
+                return;
+            }
+        }
+        rebalance(link);
+    }
+    node* extract_min(node*& link) {
+        own(link);
+        if (link->left == nullptr) {
+            node* min = link;
+            link = min->right;
+            min->right = nullptr;
+            return min;
+        }
+        node* min = extract_min(link->left);
+        rebalance(link);
+        return min;
+    }
+    void rebalance(node*& link) {
+        node* current = link;
+        int bf = balance_factor(current);
+        if (bf > 1) {
+            own(current->left);
+            if (balance_factor(current->left) < 0) {
+                own(current->left->right);
+                rotate_left(current->left);
+            }
+            rotate_right(link);
+        } else if (bf < -1) {
+            own(current->right);
+            if (balance_factor(current->right) > 0) {
+                own(current->right->left);
+                rotate_right(current->right);
+            }
+            rotate_left(link);
+        } else {
+            update_height(current);
+        }
+    }
+    // Both rotations expect the node and the child moving up to be owned.
+    void rotate_left(node*& link) {
+        node* current = link;
+        node* right = current->right;
+        current->right = right->left;
+        right->left = current;
+        update_height(current);
+        update_height(right);
+        link = right;
+    }
+    void rotate_right(node*& link) {
+        node* current = link;
+        node* left = current->left;
+        current->left = left->right;
+        left->right = current;
+        update_height(current);
+        update_height(left);
+        link = left;
+    }
+    static int height(const node* target) {
+        return target == nullptr ? 0 : target->height;
+    }
+    static int balance_factor(const node* target) {
+        return height(target->left) - height(target->right);
+    }
+    static void update_height(node* target) {
+        target->height = static_cast<int8_t>(std::max(height(target->left), height(target->right)) + 1);
+    }
+    version tree;
+    key_compare comparator;
+};
+
+} // polyndrom
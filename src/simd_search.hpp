@@ -0,0 +1,230 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#if !defined(POLYNDROM_NO_SIMD)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#endif
+
+namespace polyndrom {
+
+namespace simd_detail {
+
+// Vector operations on keys of Size bytes, compared as signed integers. The widest instruction set the
+// compiler targets is chosen at compile time, sizes without one are left unavailable.
+template <size_t Size>
+struct lanes {
+    static constexpr bool available = false;
+};
+
+#if !defined(POLYNDROM_NO_SIMD) && defined(__AVX2__)
+template <>
+struct lanes<4> {
+    static constexpr bool available = true;
+    static constexpr size_t width = 8;
+    using vector = __m256i;
+    static vector splat(int32_t value) {
+        return _mm256_set1_epi32(value);
+    }
+    static vector load(const void* from) {
+        return _mm256_loadu_si256(static_cast<const __m256i*>(from));
+    }
+    static vector flip(vector value) {
+        return _mm256_xor_si256(value, splat(std::numeric_limits<int32_t>::min()));
+    }
+    static unsigned greater(vector lhs, vector rhs) {
+        return static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(lhs, rhs))));
+    }
+};
+template <>
+struct lanes<8> {
+    static constexpr bool available = true;
+    static constexpr size_t width = 4;
+    using vector = __m256i;
+    static vector splat(int64_t value) {
+        return _mm256_set1_epi64x(value);
+    }
+    static vector load(const void* from) {
+        return _mm256_loadu_si256(static_cast<const __m256i*>(from));
+    }
+    static vector flip(vector value) {
+        return _mm256_xor_si256(value, splat(std::numeric_limits<int64_t>::min()));
+    }
+    static unsigned greater(vector lhs, vector rhs) {
+        return static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(lhs, rhs))));
+    }
+};
+#elif !defined(POLYNDROM_NO_SIMD) && defined(__SSE2__)
+template <>
+struct lanes<4> {
+    static constexpr bool available = true;
+    static constexpr size_t width = 4;
+    using vector = __m128i;
+    static vector splat(int32_t value) {
+        return _mm_set1_epi32(value);
+    }
+    static vector load(const void* from) {
+        return _mm_loadu_si128(static_cast<const __m128i*>(from));
+    }
+    static vector flip(vector value) {
+        return _mm_xor_si128(value, splat(std::numeric_limits<int32_t>::min()));
+    }
+    static unsigned greater(vector lhs, vector rhs) {
+        return static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(lhs, rhs))));
+    }
+};
+#if defined(__SSE4_2__)
+template <>
+struct lanes<8> {
+    static constexpr bool available = true;
+    static constexpr size_t width = 2;
+    using vector = __m128i;
+    static vector splat(int64_t value) {
+        return _mm_set1_epi64x(value);
+    }
+    static vector load(const void* from) {
+        return _mm_loadu_si128(static_cast<const __m128i*>(from));
+    }
+    static vector flip(vector value) {
+        return _mm_xor_si128(value, splat(std::numeric_limits<int64_t>::min()));
+    }
+    static unsigned greater(vector lhs, vector rhs) {
+        return static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(lhs, rhs))));
+    }
+};
+#endif
+#endif
+
+// Vector operations on float and double keys. Lanes compare ordered like operator<, so a NaN compares
+// neither below nor above and the vector result matches the scalar one lane for lane.
+template <class Key>
+struct floating_lanes {
+    static constexpr bool available = false;
+};
+
+#if !defined(POLYNDROM_NO_SIMD) && defined(__AVX2__)
+template <>
+struct floating_lanes<float> {
+    static constexpr bool available = true;
+    static constexpr size_t width = 8;
+    using vector = __m256;
+    static vector splat(float value) {
+        return _mm256_set1_ps(value);
+    }
+    static vector load(const void* from) {
+        return _mm256_loadu_ps(static_cast<const float*>(from));
+    }
+    static unsigned greater(vector lhs, vector rhs) {
+        return static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(lhs, rhs, _CMP_GT_OQ)));
+    }
+};
+template <>
+struct floating_lanes<double> {
+    static constexpr bool available = true;
+    static constexpr size_t width = 4;
+    using vector = __m256d;
+    static vector splat(double value) {
+        return _mm256_set1_pd(value);
+    }
+    static vector load(const void* from) {
+        return _mm256_loadu_pd(static_cast<const double*>(from));
+    }
+    static unsigned greater(vector lhs, vector rhs) {
+        return static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(lhs, rhs, _CMP_GT_OQ)));
+    }
+};
+#elif !defined(POLYNDROM_NO_SIMD) && defined(__SSE2__)
+template <>
+struct floating_lanes<float> {
+    static constexpr bool available = true;
+    static constexpr size_t width = 4;
+    using vector = __m128;
+    static vector splat(float value) {
+        return _mm_set1_ps(value);
+    }
+    static vector load(const void* from) {
+        return _mm_loadu_ps(static_cast<const float*>(from));
+    }
+    static unsigned greater(vector lhs, vector rhs) {
+        return static_cast<unsigned>(_mm_movemask_ps(_mm_cmpgt_ps(lhs, rhs)));
+    }
+};
+template <>
+struct floating_lanes<double> {
+    static constexpr bool available = true;
+    static constexpr size_t width = 2;
+    using vector = __m128d;
+    static vector splat(double value) {
+        return _mm_set1_pd(value);
+    }
+    static vector load(const void* from) {
+        return _mm_loadu_pd(static_cast<const double*>(from));
+    }
+    static unsigned greater(vector lhs, vector rhs) {
+        return static_cast<unsigned>(_mm_movemask_pd(_mm_cmpgt_pd(lhs, rhs)));
+    }
+};
+#endif
+
+template <class Key>
+using key_lanes = std::conditional_t<std::is_floating_point_v<Key>, floating_lanes<std::remove_cv_t<Key>>,
+                                     lanes<sizeof(Key)>>;
+
+} // simd_detail
+
+// 32 and 64 bit integer, float and double keys, which simd_rank() compares a vector at a time when the
+// target supports it. Other keys, long double among them, take the scalar search.
+template <class Key>
+struct is_simd_searchable
+    : std::bool_constant<(std::is_integral_v<Key> || std::is_floating_point_v<Key>) && !std::is_same_v<Key, bool> &&
+                         simd_detail::key_lanes<Key>::available> {};
+
+// Returns the number of leading keys of the sorted array that are less than key, or not greater than
+// key when Inclusive is set, that is the lower_bound or the upper_bound index. The array is scanned a
+// vector at a time, the lanes that compare below key form a prefix of the mask and the first vector
+// with a lane at or above key ends the scan.
+template <bool Inclusive, class Key>
+size_t simd_rank(const Key* keys, size_t count, Key key) {
+    static_assert(is_simd_searchable<Key>::value,
+                  "simd_rank() needs integer, float or double keys and a vector instruction set");
+    using ops = simd_detail::key_lanes<Key>;
+    using vector = typename ops::vector;
+    constexpr unsigned full = (1u << ops::width) - 1;
+    // Unsigned keys are flipped into the signed range, the instruction sets only compare signed lanes.
+    auto prepare = [](vector value) {
+        if constexpr (std::is_unsigned_v<Key>) {
+            return ops::flip(value);
+        } else {
+            return value;
+        }
+    };
+    vector needle;
+    if constexpr (std::is_floating_point_v<Key>) {
+        needle = ops::splat(key);
+    } else {
+        needle = prepare(ops::splat(static_cast<std::make_signed_t<Key>>(key)));
+    }
+    size_t index = 0;
+    for (; index + ops::width <= count; index += ops::width) {
+        vector chunk = prepare(ops::load(keys + index));
+        unsigned below = Inclusive ? ~ops::greater(chunk, needle) & full : ops::greater(needle, chunk);
+        if (below != full) {
+            return index + static_cast<size_t>(__builtin_ctz(~below));
+        }
+    }
+    while (index < count && (Inclusive ? !(key < keys[index]) : keys[index] < key)) {
+        ++index;
+    }
+    return index;
+}
+
+} // polyndrom
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace polyndrom {
+
+// A fork-join pool. Every worker owns a deque of tasks: fork_join() pushes its second call to the back of
+// the caller's deque and runs the first, idle workers steal from the front of the other deques, so the
+// oldest and usually largest pieces of work move between threads. A worker waiting for a stolen task runs
+// other tasks meanwhile. The thread calling run() takes part as worker 0.
+class work_stealing_pool {
+public:
+    explicit work_stealing_pool(size_t threads = std::thread::hardware_concurrency())
+        : queues(std::max<size_t>(threads, 1)) {
+        for (auto& own : queues) {
+            own = std::make_unique<queue>();
+        }
+        try {
+            for (size_t index = 1; index < queues.size(); index++) {
+                workers.emplace_back([this, index] {
+                    work(index);
+                });
+            }
+        } catch (...) {
+            stop();
+            throw;
+        }
+    }
+    work_stealing_pool(const work_stealing_pool&) = delete;
+    work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+    ~work_stealing_pool() {
+        stop();
+    }
+    size_t size() const {
+        return queues.size();
+    }
+    // Runs f with the pool's workers available to the fork_join() calls it makes. Calls from a worker of
+    // this pool run f directly, calls from other threads are serialized.
+    template <class F>
+    void run(F f) {
+        if (current().pool == this) {
+            f();
+            return;
+        }
+        std::lock_guard<std::mutex> run_lock(run_mutex);
+        slot saved = std::exchange(current(), slot{this, 0});
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            ++active;
+        }
+        state_changed.notify_all();
+        try {
+            f();
+        } catch (...) {
+            finish_run(saved);
+            throw;
+        }
+        finish_run(saved);
+    }
+    // Runs first and second, possibly in parallel, and returns when both are done. Outside of run() both
+    // are called in order on the calling thread. The first exception of the two is rethrown.
+    template <class First, class Second>
+    void fork_join(First first, Second second) {
+        slot self = current();
+        if (self.pool != this) {
+            first();
+            second();
+            return;
+        }
+        task forked(second);
+        queue& own = *queues[self.index];
+        {
+            std::lock_guard<std::mutex> lock(own.mutex);
+            own.tasks.push_back(&forked);
+        }
+        std::exception_ptr error;
+        try {
+            first();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        bool stolen = true;
+        {
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty() && own.tasks.back() == &forked) {
+                own.tasks.pop_back();
+                stolen = false;
+            }
+        }
+        if (!stolen) {
+            forked.execute();
+        }
+        while (!forked.done.load(std::memory_order_acquire)) {
+            if (!run_one(self.index)) {
+                std::this_thread::yield();
+            }
+        }
+        if (error == nullptr) {
+            error = forked.error;
+        }
+        if (error != nullptr) {
+            std::rethrow_exception(error);
+        }
+    }
+private:
+    struct task {
+        explicit task(std::function<void()> body) : body(std::move(body)) {}
+        void execute() {
+            try {
+                body();
+            } catch (...) {
+                error = std::current_exception();
+            }
+            done.store(true, std::memory_order_release);
+        }
+        std::function<void()> body;
+        std::exception_ptr error;
+        std::atomic<bool> done{false};
+    };
+    struct queue {
+        std::mutex mutex;
+        std::deque<task*> tasks;
+    };
+    struct slot {
+        work_stealing_pool* pool = nullptr;
+        size_t index = 0;
+    };
+    static slot& current() {
+        static thread_local slot value;
+        return value;
+    }
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            stopping = true;
+        }
+        state_changed.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+    void finish_run(slot saved) {
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            --active;
+        }
+        current() = saved;
+    }
+    // Runs a task of the worker's own deque, newest first, or one stolen from another deque, oldest first.
+    bool run_one(size_t index) {
+        task* found = nullptr;
+        {
+            queue& own = *queues[index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                found = own.tasks.back();
+                own.tasks.pop_back();
+            }
+        }
+        for (size_t step = 1; found == nullptr && step < queues.size(); step++) {
+            queue& victim = *queues[(index + step) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                found = victim.tasks.front();
+                victim.tasks.pop_front();
+            }
+        }
+        if (found == nullptr) {
+            return false;
+        }
+        found->execute();
+        return true;
+    }
+    void work(size_t index) {
+        current() = slot{this, index};
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(state_mutex);
+                state_changed.wait(lock, [this] {
+                    return stopping || active > 0;
+                });
+                if (stopping) {
+                    return;
+                }
+            }
+            if (!run_one(index)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+    std::vector<std::unique_ptr<queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex run_mutex;
+    std::mutex state_mutex;
+    std::condition_variable state_changed;
+    size_t active = 0;
+    bool stopping = false;
+};
+
+} // polyndrom
@@ -0,0 +1,408 @@
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace polyndrom {
+
+enum class durability {
+    // Every write performs its own fdatasync before returning.
+    sync,
+    // Concurrent writers share fdatasync calls: one of them flushes everything appended so far while the
+    // others wait for it, a write returns once a flush covering it finished.
+    group,
+    // Writes return right after being appended, a background thread flushes periodically, a crash may
+    // lose the last flush interval.
+    async
+};
+
+// Turns keys and mapped values into log bytes and back. Specialize for types that are neither trivially
+// copyable nor strings.
+template <class T, class = void>
+struct wal_codec;
+
+template <class T>
+struct wal_codec<T, std::enable_if_t<std::is_trivially_copyable_v<T>>> {
+    static void write(std::string& out, const T& value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+    static T read(std::string_view& in) {
+        if (in.size() < sizeof(T)) {
+            throw std::runtime_error("Truncated log record");
+        }
+        T value;
+        std::memcpy(&value, in.data(), sizeof(T));
+        in.remove_prefix(sizeof(T));
+        return value;
+    }
+};
+
+template <class CharT, class Traits, class Alloc>
+struct wal_codec<std::basic_string<CharT, Traits, Alloc>> {
+    using string_type = std::basic_string<CharT, Traits, Alloc>;
+    static void write(std::string& out, const string_type& value) {
+        wal_codec<uint32_t>::write(out, static_cast<uint32_t>(value.size()));
+        out.append(reinterpret_cast<const char*>(value.data()), value.size() * sizeof(CharT));
+    }
+    static string_type read(std::string_view& in) {
+        size_t length = wal_codec<uint32_t>::read(in);
+        if (in.size() < length * sizeof(CharT)) {
+            throw std::runtime_error("Truncated log record");
+        }
+        string_type value(length, CharT());
+        std::memcpy(value.data(), in.data(), length * sizeof(CharT));
+        in.remove_prefix(length * sizeof(CharT));
+        return value;
+    }
+};
+
+inline uint32_t crc32(std::string_view data) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> result{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320u : 0);
+            }
+            result[i] = crc;
+        }
+        return result;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (char c : data) {
+        crc = table[(crc ^ static_cast<unsigned char>(c)) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// Syncs the directory holding path, so a file created or renamed there survives a crash.
+inline void sync_parent_directory(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "Cannot open " + directory);
+    }
+    int result = ::fsync(fd);
+    int code = errno;
+    ::close(fd);
+    if (result != 0) {
+        throw std::system_error(code, std::generic_category(), "Cannot sync " + directory);
+    }
+}
+
+// An append only file of checksummed records: a 4 byte payload length, a 4 byte CRC32 of the payload
+// and the payload. Records are buffered in memory by append and written by flush, so the order of
+// appends is the order in the file. A torn or corrupt tail left by a crash is cut off when the log is
+// opened again. rewrite replaces the whole log, which keeps it from growing without bound.
+class write_ahead_log {
+public:
+    write_ahead_log(const std::string& path, durability level,
+                    std::chrono::milliseconds async_interval = std::chrono::milliseconds(10))
+        : path(path), level(level), async_interval(async_interval) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "Cannot open " + path);
+        }
+        struct stat status{};
+        if (::fstat(fd, &status) != 0) {
+            int code = errno;
+            ::close(fd);
+            throw std::system_error(code, std::generic_category(), "Cannot open " + path);
+        }
+        file_size = static_cast<size_t>(status.st_size);
+        if (file_size == 0) {
+            try {
+                sync_parent_directory(path);
+            } catch (...) {
+                ::close(fd);
+                throw;
+            }
+        }
+        if (level == durability::async) {
+            flusher = std::thread([this] {
+                flush_periodically();
+            });
+        }
+    }
+    write_ahead_log(const write_ahead_log&) = delete;
+    write_ahead_log& operator=(const write_ahead_log&) = delete;
+    ~write_ahead_log() {
+        if (flusher.joinable()) {
+            {
+                std::lock_guard lock(mutex);
+                stopping = true;
+            }
+            flushed.notify_all();
+            flusher.join();
+        }
+        try {
+            std::unique_lock lock(mutex);
+            while (flushing) {
+                flushed.wait(lock);
+            }
+            if (!pending.empty()) {
+                flush(lock);
+            }
+        } catch (...) {
+        }
+        ::close(fd);
+    }
+    // Calls apply with every intact record payload in order and drops whatever follows the first damaged
+    // record. The file is read in chunks, only a record spanning chunks is held in memory whole. Must be
+    // called before the first append.
+    template <class Apply>
+    void replay(Apply apply) {
+        std::string buffer;
+        size_t buffer_offset = 0;
+        size_t total = 0;
+        char chunk[1 << 16];
+        bool damaged = false;
+        while (!damaged) {
+            std::string_view rest(buffer);
+            while (rest.size() >= header_size) {
+                std::string_view header = rest.substr(0, header_size);
+                uint32_t length = wal_codec<uint32_t>::read(header);
+                uint32_t checksum = wal_codec<uint32_t>::read(header);
+                if (rest.size() - header_size < length) {
+                    break;
+                }
+                std::string_view payload = rest.substr(header_size, length);
+                if (crc32(payload) != checksum) {
+                    damaged = true;
+                    break;
+                }
+                apply(payload);
+                rest.remove_prefix(header_size + length);
+            }
+            size_t consumed = buffer.size() - rest.size();
+            buffer.erase(0, consumed);
+            buffer_offset += consumed;
+            if (damaged) {
+                break;
+            }
+            ssize_t count = ::pread(fd, chunk, sizeof(chunk), static_cast<off_t>(total));
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "Cannot read log");
+            }
+            if (count == 0) {
+                break;
+            }
+            buffer.append(chunk, static_cast<size_t>(count));
+            total += static_cast<size_t>(count);
+        }
+        file_size = buffer_offset;
+        if (file_size != total) {
+            // The cut has to be durable before new records follow it, or a crash could bring the torn
+            // tail back between them.
+            if (::ftruncate(fd, static_cast<off_t>(file_size)) != 0 || ::fdatasync(fd) != 0) {
+                throw std::system_error(errno, std::generic_category(), "Cannot truncate log");
+            }
+        }
+    }
+    // Buffers a record and returns its sequence number, to be passed to wait_durable.
+    uint64_t append(std::string_view payload) {
+        std::lock_guard lock(mutex);
+        if (error) {
+            throw std::system_error(error, "Log is unusable after a failed write");
+        }
+        encode(pending, payload);
+        return ++appended;
+    }
+    // Replaces the log with the records fill passes to the function it is called with. Records appended
+    // before are flushed first, the new ones are written to a temporary file, synced and renamed over the
+    // log, so a crash leaves either log whole. The caller keeps appends out until it returns; on failure
+    // the old log stays in place and in use.
+    template <class Fill>
+    void rewrite(Fill fill) {
+        std::unique_lock lock(mutex);
+        while (flushing) {
+            flushed.wait(lock);
+        }
+        if (error) {
+            throw std::system_error(error, "Log is unusable after a failed write");
+        }
+        if (!pending.empty()) {
+            flush(lock);
+        }
+        flushing = true;
+        lock.unlock();
+        std::string temp_path = path + ".tmp";
+        int temp_fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        size_t written = 0;
+        std::error_code result;
+        if (temp_fd < 0) {
+            result = std::error_code(errno, std::generic_category());
+        } else {
+            try {
+                std::string batch;
+                auto write_batch = [&] {
+                    std::error_code code = write_all(temp_fd, batch, static_cast<off_t>(written));
+                    if (code) {
+                        throw std::system_error(code, "Cannot write " + temp_path);
+                    }
+                    written += batch.size();
+                    batch.clear();
+                };
+                fill([&](std::string_view payload) {
+                    encode(batch, payload);
+                    if (batch.size() >= rewrite_batch_size) {
+                        write_batch();
+                    }
+                });
+                write_batch();
+                if (::fdatasync(temp_fd) != 0) {
+                    result = std::error_code(errno, std::generic_category());
+                } else if (::rename(temp_path.c_str(), path.c_str()) != 0) {
+                    result = std::error_code(errno, std::generic_category());
+                }
+            } catch (...) {
+                ::close(temp_fd);
+                ::unlink(temp_path.c_str());
+                lock.lock();
+                flushing = false;
+                flushed.notify_all();
+                throw;
+            }
+        }
+        lock.lock();
+        flushing = false;
+        if (result) {
+            if (temp_fd >= 0) {
+                ::close(temp_fd);
+                ::unlink(temp_path.c_str());
+            }
+            flushed.notify_all();
+            throw std::system_error(result, "Cannot rewrite " + path);
+        }
+        ::close(fd);
+        fd = temp_fd;
+        file_size = written;
+        flushed.notify_all();
+        lock.unlock();
+        sync_parent_directory(path);
+    }
+    // Returns once the record is on stable storage as the durability level demands.
+    void wait_durable(uint64_t sequence) {
+        if (level == durability::async) {
+            return;
+        }
+        std::unique_lock lock(mutex);
+        bool own_flush = level == durability::sync;
+        while (durable < sequence || own_flush) {
+            if (error) {
+                throw std::system_error(error, "Log write failed");
+            }
+            if (flushing) {
+                flushed.wait(lock);
+                continue;
+            }
+            flush(lock);
+            own_flush = false;
+        }
+    }
+    uint64_t durable_sequence() const {
+        std::lock_guard lock(mutex);
+        return durable;
+    }
+    size_t size() const {
+        std::lock_guard lock(mutex);
+        return file_size;
+    }
+private:
+    static constexpr size_t header_size = 2 * sizeof(uint32_t);
+    static constexpr size_t rewrite_batch_size = 1 << 20;
+    static void encode(std::string& out, std::string_view payload) {
+        wal_codec<uint32_t>::write(out, static_cast<uint32_t>(payload.size()));
+        wal_codec<uint32_t>::write(out, crc32(payload));
+        out.append(payload);
+    }
+    // Writes and syncs everything pending with the lock released, other threads queue behind flushing.
+    void flush(std::unique_lock<std::mutex>& lock) {
+        flushing = true;
+        std::string batch;
+        batch.swap(pending);
+        uint64_t covered = appended;
+        off_t offset = static_cast<off_t>(file_size);
+        lock.unlock();
+        std::error_code result = write_all(fd, batch, offset);
+        if (!result && ::fdatasync(fd) != 0) {
+            result = std::error_code(errno, std::generic_category());
+        }
+        lock.lock();
+        flushing = false;
+        if (result) {
+            error = result;
+        } else {
+            file_size += batch.size();
+            durable = covered;
+        }
+        flushed.notify_all();
+        if (result) {
+            throw std::system_error(result, "Log write failed");
+        }
+    }
+    static std::error_code write_all(int fd, const std::string& batch, off_t offset) {
+        size_t written = 0;
+        while (written < batch.size()) {
+            ssize_t count = ::pwrite(fd, batch.data() + written, batch.size() - written,
+                                     offset + static_cast<off_t>(written));
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return std::error_code(errno, std::generic_category());
+            }
+            written += static_cast<size_t>(count);
+        }
+        return std::error_code();
+    }
+    void flush_periodically() {
+        std::unique_lock lock(mutex);
+        while (!stopping) {
+            flushed.wait_for(lock, async_interval, [this] {
+                return stopping;
+            });
+            if (!pending.empty() && !flushing && !error) {
+                try {
+                    flush(lock);
+                } catch (const std::system_error&) {
+                }
+            }
+        }
+    }
+    std::string path;
+    int fd = -1;
+    durability level;
+    std::chrono::milliseconds async_interval;
+    mutable std::mutex mutex;
+    std::condition_variable flushed;
+    std::string pending;
+    uint64_t appended = 0;
+    uint64_t durable = 0;
+    size_t file_size = 0;
+    bool flushing = false;
+    bool stopping = false;
+    std::error_code error;
+    std::thread flusher;
+};
+
+} // polyndrom
@@ -0,0 +1,192 @@
+#include "acid_btree.hpp"
+#include "node_pool.hpp"
+#include "utils.hpp"
+
+#include <map>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+template <class Map, class Expected>
+void expect_same(const Map& map, const Expected& expected) {
+    EXPECT_EQ(map.size(), expected.size());
+    auto expected_it = expected.begin();
+    for (auto& [key, value] : map) {
+        ASSERT_NE(expected_it, expected.end());
+        EXPECT_EQ(key, expected_it->first);
+        EXPECT_EQ(value, expected_it->second);
+        ++expected_it;
+    }
+    EXPECT_EQ(expected_it, expected.end());
+    auto expected_reverse = expected.rbegin();
+    for (auto it = map.end(); it != map.begin();) {
+        --it;
+        ASSERT_NE(expected_reverse, expected.rend());
+        EXPECT_EQ(it->first, expected_reverse->first);
+        ++expected_reverse;
+    }
+    EXPECT_EQ(expected_reverse, expected.rend());
+}
+
+// Allocations left before failing_allocator throws std::bad_alloc, it never throws while negative.
+inline int allocations_left = -1;
+
+template <class T>
+struct failing_allocator {
+    using value_type = T;
+    failing_allocator() = default;
+    template <class U>
+    failing_allocator(const failing_allocator<U>&) {}
+    T* allocate(size_t n) {
+        if (allocations_left == 0) {
+            throw std::bad_alloc();
+        }
+        if (allocations_left > 0) {
+            allocations_left--;
+        }
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T* target, size_t n) {
+        std::allocator<T>().deallocate(target, n);
+    }
+    template <class U>
+    bool operator==(const failing_allocator<U>&) const {
+        return true;
+    }
+    template <class U>
+    bool operator!=(const failing_allocator<U>&) const {
+        return false;
+    }
+};
+
+TEST(BTreeTest, MatchesStdMap) {
+    polyndrom::acid_btree<complex_object, int> map;
+    complex_object_generator generator;
+    std::vector<complex_object> keys;
+    for (int i = 0; i < 3000; i++) {
+        keys.push_back(generator.next_value());
+    }
+    expect_matches_std_map(map, keys, 30000, keys);
+    for (const complex_object& key : keys) {
+        map.erase(key);
+    }
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(map.begin(), map.end());
+}
+TEST(BTreeTest, ErasedIteratorsStepToNeighbours) {
+    int n = 10000;
+    polyndrom::acid_btree<int, int> map;
+    std::vector<decltype(map.begin())> its;
+    for (int i = 0; i < n; i++) {
+        its.push_back(map.emplace(i, i).first);
+    }
+    for (int i = 0; i < n; i += 2) {
+        map.erase(its[i]);
+    }
+    for (int i = 0; i < n; i++) {
+        auto it = its[i];
+        EXPECT_EQ(it->first, i);
+        ++it;
+        if (i + 1 < n) {
+            EXPECT_EQ(it->first, i % 2 == 0 ? i + 1 : i + 2);
+        } else {
+            EXPECT_EQ(it, map.end());
+        }
+        it = its[i];
+        --it;
+        if (i > 1) {
+            EXPECT_EQ(it->first, i % 2 == 0 ? i - 1 : i - 2);
+        } else {
+            EXPECT_EQ(it, map.end());
+        }
+    }
+    int_generator generator(0, n - 1);
+    for (int step = 0; step < 1000; step++) {
+        auto it = its[generator.next_value()];
+        map.erase(it);
+        auto erased = it++;
+        EXPECT_FALSE(map.contains(erased->first));
+        if (it != map.end()) {
+            EXPECT_TRUE(map.contains(it->first));
+            EXPECT_GT(it->first, erased->first);
+        }
+    }
+}
+TEST(BTreeTest, EraseThroughStaleIterator) {
+    polyndrom::acid_btree<int, int> map;
+    for (int i = 0; i < 10; i++) {
+        map.emplace(i, i);
+    }
+    auto stale = map.find(5);
+    map.erase(5);
+    map.emplace(5, 50);
+    auto next = map.erase(stale);
+    EXPECT_EQ(map.size(), 10);
+    EXPECT_TRUE(map.contains(5));
+    EXPECT_EQ(map.find(5)->second, 50);
+    EXPECT_EQ(next->first, 6);
+}
+TEST(BTreeTest, ClearWithErasedIterators) {
+    using pool_allocator = polyndrom::node_pool_allocator<std::pair<const int, int>>;
+    pool_allocator allocator;
+    int n = 10000;
+    {
+        polyndrom::acid_btree<int, int, std::less<int>, pool_allocator> map(allocator);
+        std::vector<decltype(map.begin())> its;
+        for (int i = 0; i < n; i++) {
+            its.push_back(map.emplace(i, i).first);
+        }
+        for (int i = 0; i < n; i += 3) {
+            map.erase(its[i]);
+        }
+        map.clear();
+        EXPECT_EQ(map.size(), 0);
+        EXPECT_EQ(map.begin(), map.end());
+        for (auto it : its) {
+            auto it2 = it;
+            ++it;
+            --it2;
+            EXPECT_EQ(it, map.end());
+            EXPECT_EQ(it2, map.end());
+        }
+        EXPECT_GE(allocator.in_use(), static_cast<size_t>(n));
+        its.clear();
+        EXPECT_EQ(allocator.in_use(), 0);
+        for (int i = 0; i < n; i++) {
+            map.emplace(i, i);
+        }
+        EXPECT_EQ(map.size(), n);
+    }
+    EXPECT_EQ(allocator.in_use(), 0);
+}
+TEST(BTreeTest, FailedAllocationsLeaveTheTreeIntact) {
+    polyndrom::acid_btree<int, int, std::less<int>, failing_allocator<std::pair<const int, int>>> map;
+    std::map<int, int> expected;
+    for (int i = 0; i < 5000; i++) {
+        for (int failing = 0;; failing++) {
+            allocations_left = failing;
+            try {
+                map.emplace(i, i);
+                break;
+            } catch (const std::bad_alloc&) {
+                allocations_left = -1;
+            }
+            if (failing > 0) {
+                expect_same(map, expected);
+            }
+        }
+        allocations_left = -1;
+        expected.emplace(i, i);
+    }
+    expect_same(map, expected);
+}
+TEST(BTreeTest, IncrementEndAfterInsert) {
+    polyndrom::acid_btree<int, int> map;
+    map.emplace(1, 1);
+    auto it = map.end();
+    map.emplace(2, 2);
+    ++it;
+    EXPECT_EQ(it, map.end());
+}
@@ -0,0 +1,117 @@
+#include "checkpoint.hpp"
+#include "utils.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+class CheckpointTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        path_ = (std::filesystem::temp_directory_path() /
+                 ("checkpoint_test_" + std::to_string(::getpid()) + "_" +
+                  ::testing::UnitTest::GetInstance()->current_test_info()->name() + ".ckpt")).string();
+        std::filesystem::remove(path_);
+    }
+    void TearDown() override {
+        std::filesystem::remove(path_);
+    }
+    std::string path_;
+};
+
+TEST_F(CheckpointTest, ServesLookupsAndMaterializes) {
+    polyndrom::acid_map<std::string, int> map;
+    std::map<std::string, int> expected;
+    string_generator generator(1, 40);
+    for (int i = 0; i < 5000; i++) {
+        std::string key = generator.next_value();
+        map[key] = i;
+        expected[key] = i;
+    }
+    polyndrom::write_checkpoint(path_, map, 512);
+    polyndrom::checkpoint_view<std::string, int> view(path_);
+    EXPECT_TRUE(view.verify());
+    ASSERT_EQ(view.size(), expected.size());
+    auto expected_it = expected.begin();
+    for (auto [key, value] : view) {
+        ASSERT_NE(expected_it, expected.end());
+        EXPECT_EQ(key, expected_it->first);
+        EXPECT_EQ(value, expected_it->second);
+        ++expected_it;
+    }
+    EXPECT_EQ(expected_it, expected.end());
+    for (int i = 0; i < 5000; i++) {
+        std::string key = generator.next_value();
+        auto expected_found = expected.find(key);
+        std::optional<int> found = view.get(key);
+        ASSERT_EQ(found.has_value(), expected_found != expected.end());
+        if (found) {
+            EXPECT_EQ(*found, expected_found->second);
+        }
+        auto lower = view.lower_bound(key);
+        auto expected_lower = expected.lower_bound(key);
+        ASSERT_EQ(lower == view.end(), expected_lower == expected.end());
+        if (lower != view.end()) {
+            EXPECT_EQ((*lower).first, expected_lower->first);
+        }
+    }
+    auto restored = view.materialize();
+    EXPECT_EQ(restored.size(), expected.size());
+    EXPECT_TRUE(std::equal(restored.begin(), restored.end(), expected.begin(), expected.end()));
+    auto building = view.materialize_async();
+    for (auto& [key, value] : expected) {
+        EXPECT_EQ(view.get(key), value);
+    }
+    auto built = building.get();
+    EXPECT_TRUE(std::equal(built->begin(), built->end(), expected.begin(), expected.end()));
+}
+TEST_F(CheckpointTest, EmptyMap) {
+    polyndrom::acid_map<int, int> map;
+    polyndrom::write_checkpoint(path_, map);
+    polyndrom::checkpoint_view<int, int> view(path_);
+    EXPECT_TRUE(view.empty());
+    EXPECT_EQ(view.begin(), view.end());
+    EXPECT_FALSE(view.contains(1));
+    EXPECT_EQ(view.lower_bound(1), view.end());
+    EXPECT_TRUE(view.materialize().empty());
+}
+TEST_F(CheckpointTest, RejectsForeignAndDamagedFiles) {
+    polyndrom::acid_map<int, int> map;
+    for (int i = 0; i < 1000; i++) {
+        map[i] = -i;
+    }
+    polyndrom::write_checkpoint(path_, map, 256);
+    EXPECT_THROW((polyndrom::checkpoint_view<int64_t, int>(path_)), std::runtime_error);
+    std::vector<std::pair<int, std::string>> large = {{1, std::string(300, 'x')}};
+    EXPECT_THROW((polyndrom::write_checkpoint<int, std::string>(path_, large.begin(), large.end(), 256)),
+                 std::length_error);
+    std::vector<std::pair<int, int>> unsorted = {{2, 0}, {1, 0}};
+    EXPECT_THROW((polyndrom::write_checkpoint<int, int>(path_, unsorted.begin(), unsorted.end())),
+                 std::invalid_argument);
+    EXPECT_FALSE(std::filesystem::exists(path_ + ".tmp"));
+    {
+        polyndrom::checkpoint_view<int, int> view(path_);
+        EXPECT_EQ(view.size(), 1000);
+        EXPECT_EQ(view.get(999), -999);
+    }
+    {
+        std::fstream file(path_, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(3 * 256 + 100);
+        file.put('\x7f');
+    }
+    {
+        polyndrom::checkpoint_view<int, int> view(path_);
+        EXPECT_FALSE(view.verify());
+    }
+    {
+        std::fstream file(path_, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(12);
+        file.put('\x7f');
+    }
+    EXPECT_THROW((polyndrom::checkpoint_view<int, int>(path_)), std::runtime_error);
+    std::filesystem::resize_file(path_, 10);
+    EXPECT_THROW((polyndrom::checkpoint_view<int, int>(path_)), std::runtime_error);
+}
@@ -0,0 +1,288 @@
+#include "concurrent_acid_map.hpp"
+#include "utils.hpp"
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+TEST(ConcurrentMapTest, MatchesStdMap) {
+    polyndrom::concurrent_acid_map<int, int> map(8);
+    std::vector<int> keys;
+    for (int key = 0; key <= 3000; key++) {
+        keys.push_back(key);
+    }
+    expect_matches_std_map(map, keys, 10000, keys);
+}
+TEST(ConcurrentMapTest, ParallelWriters) {
+    polyndrom::concurrent_acid_map<int, int> map;
+    int threads = 8;
+    int per_thread = 5000;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            for (int i = 0; i < per_thread; i++) {
+                map.emplace(i * threads + t, t);
+            }
+            for (int i = 0; i < per_thread; i += 2) {
+                map.erase(i * threads + t);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    EXPECT_EQ(map.size(), threads * per_thread / 2);
+    int previous = -1;
+    int count = 0;
+    for (auto& [key, value] : map) {
+        EXPECT_LT(previous, key);
+        EXPECT_EQ(key / threads % 2, 1);
+        EXPECT_EQ(value, key % threads);
+        previous = key;
+        ++count;
+    }
+    EXPECT_EQ(count, threads * per_thread / 2);
+}
+TEST(ConcurrentMapTest, ReadersAndVisitorsDuringWrites) {
+    polyndrom::concurrent_acid_map<int, int> map;
+    int n = 20000;
+    for (int i = 0; i < n; i++) {
+        map.emplace(i, 0);
+    }
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; t++) {
+        workers.emplace_back([&] {
+            for (int i = 0; i < n; i++) {
+                map.visit(i, [](auto& value) {
+                    ++value.second;
+                });
+            }
+        });
+        workers.emplace_back([&] {
+            for (int i = 0; i < n; i++) {
+                int seen = -1;
+                EXPECT_TRUE(map.cvisit(i, [&](const auto& value) {
+                    seen = value.second;
+                }));
+                EXPECT_GE(seen, 0);
+                EXPECT_TRUE(map.contains(i));
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (int i = 0; i < n; i++) {
+        map.cvisit(i, [](const auto& value) {
+            EXPECT_EQ(value.second, 4);
+        });
+    }
+}
+TEST(ConcurrentMapTest, IteratorsSurviveConcurrentErase) {
+    polyndrom::concurrent_acid_map<int, int> map(4);
+    int n = 20000;
+    for (int i = 0; i < n; i++) {
+        map.emplace(i, i);
+    }
+    std::thread eraser([&] {
+        for (int i = 0; i < n; i += 2) {
+            map.erase(i);
+        }
+    });
+    int previous = -1;
+    for (auto it = map.begin(); it != map.end(); ++it) {
+        EXPECT_LT(previous, it->first);
+        previous = it->first;
+    }
+    eraser.join();
+    EXPECT_EQ(map.size(), n / 2);
+    int expected = 1;
+    for (auto& [key, value] : map) {
+        EXPECT_EQ(key, expected);
+        expected += 2;
+    }
+    EXPECT_EQ(expected, n + 1);
+    auto it = map.find(101);
+    auto copy = it;
+    map.erase(101);
+    map.erase(103);
+    ++it;
+    EXPECT_EQ(it->first, 105);
+    it = map.erase(copy);
+    EXPECT_EQ(it->first, 105);
+    map.clear();
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(map.begin(), map.end());
+    EXPECT_EQ(map.erase(map.end()), map.end());
+}
+TEST(ConcurrentMapTest, LockFreeLookupsDuringRebalancing) {
+    polyndrom::concurrent_acid_map<std::string, int> map(2);
+    int n = 4000;
+    for (int i = 0; i < n; i += 2) {
+        map.emplace(std::to_string(i), i);
+    }
+    std::atomic<bool> done{false};
+    std::thread writer([&] {
+        for (int round = 0; round < 20; round++) {
+            for (int i = 1; i < n; i += 2) {
+                map.emplace(std::to_string(i), i);
+            }
+            for (int i = 1; i < n; i += 2) {
+                map.erase(std::to_string(i));
+            }
+        }
+        done = true;
+    });
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; t++) {
+        readers.emplace_back([&] {
+            while (!done) {
+                for (int i = 0; i < n; i += 2) {
+                    EXPECT_TRUE(map.contains(std::to_string(i)));
+                }
+                EXPECT_FALSE(map.contains("x"));
+            }
+        });
+    }
+    writer.join();
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    EXPECT_EQ(map.size(), n / 2);
+}
+TEST(ConcurrentMapTest, CopiedVisitsSeeWholeValues) {
+    polyndrom::concurrent_acid_map<int, std::pair<long, long>> map(1);
+    for (int i = 0; i < 100; i++) {
+        map.emplace(i, std::make_pair(0L, 0L));
+    }
+    std::atomic<bool> done{false};
+    std::thread writer([&] {
+        for (long round = 1; round < 2000; round++) {
+            for (int i = 0; i < 100; i++) {
+                map.insert_or_assign(i, std::make_pair(round, -round));
+            }
+        }
+        done = true;
+    });
+    while (!done) {
+        for (int i = 0; i < 100; i++) {
+            EXPECT_TRUE(map.cvisit(i, [](const auto& value) {
+                EXPECT_EQ(value.second.first, -value.second.second);
+            }));
+        }
+    }
+    writer.join();
+}
+TEST(EpochTest, ReclamationWaitsForPinnedReaders) {
+    polyndrom::epoch_domain domain;
+    polyndrom::epoch_allocator<std::string> allocator(std::allocator<std::string>(), domain);
+    auto& retired = allocator.retire_queue();
+    std::string* value = allocator.allocate(1);
+    allocator.construct(value, "retired while a reader is pinned");
+    {
+        polyndrom::epoch_domain::guard guard = domain.pin();
+        allocator.destroy(value);
+        allocator.deallocate(value, 1);
+        for (int i = 0; i < 5; i++) {
+            retired.collect();
+        }
+        EXPECT_EQ(retired.size(), 2);
+        EXPECT_EQ(value->size(), 32);
+    }
+    retired.collect();
+    retired.collect();
+    EXPECT_EQ(retired.size(), 0);
+}
+TEST(ConcurrentMapTest, TransactionsBufferAndValidate) {
+    polyndrom::concurrent_acid_map<int, int> map(4);
+    map.emplace(1, 10);
+    map.emplace(2, 20);
+    auto tx = map.begin_transaction();
+    EXPECT_EQ(tx.get(1), 10);
+    tx.insert_or_assign(1, 11);
+    tx.erase(2);
+    tx.insert_or_assign(3, 30);
+    EXPECT_EQ(tx.get(1), 11);
+    EXPECT_FALSE(tx.contains(2));
+    EXPECT_FALSE(map.contains(3));
+    EXPECT_TRUE(tx.commit());
+    EXPECT_EQ(map.size(), 2);
+    map.cvisit(1, [](const auto& value) {
+        EXPECT_EQ(value.second, 11);
+    });
+    EXPECT_FALSE(map.contains(2));
+    EXPECT_TRUE(map.contains(3));
+
+    auto conflicting = map.begin_transaction();
+    EXPECT_EQ(conflicting.get(3), 30);
+    EXPECT_FALSE(conflicting.get(4).has_value());
+    conflicting.insert_or_assign(1, 0);
+    map.insert_or_assign(4, 40);
+    EXPECT_FALSE(conflicting.commit());
+    map.cvisit(1, [](const auto& value) {
+        EXPECT_EQ(value.second, 11);
+    });
+
+    auto rolled_back = map.begin_transaction();
+    rolled_back.erase(1);
+    rolled_back.rollback();
+    EXPECT_TRUE(rolled_back.commit());
+    EXPECT_TRUE(map.contains(1));
+}
+TEST(ConcurrentMapTest, ConcurrentTransfersKeepTheTotal) {
+    polyndrom::concurrent_acid_map<int, int> map(8);
+    int accounts = 16;
+    for (int i = 0; i < accounts; i++) {
+        map.emplace(i, 100);
+    }
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; t++) {
+        workers.emplace_back([&, t] {
+            int_generator generator(0, accounts - 1, t);
+            for (int i = 0; i < 2000; i++) {
+                int from = generator.next_value();
+                int to = generator.next_value();
+                while (true) {
+                    auto tx = map.begin_transaction();
+                    int balance = *tx.get(from);
+                    if (balance > 0 && from != to) {
+                        tx.insert_or_assign(from, balance - 1);
+                        tx.insert_or_assign(to, *tx.get(to) + 1);
+                    }
+                    if (tx.commit()) {
+                        break;
+                    }
+                }
+            }
+        });
+    }
+    std::thread auditor([&] {
+        for (int i = 0; i < 200; i++) {
+            while (true) {
+                auto tx = map.begin_transaction();
+                int total = 0;
+                for (int account = 0; account < accounts; account++) {
+                    total += *tx.get(account);
+                }
+                if (tx.commit()) {
+                    EXPECT_EQ(total, 100 * accounts);
+                    break;
+                }
+            }
+        }
+    });
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    auditor.join();
+    int total = 0;
+    for (auto& [key, value] : map) {
+        EXPECT_GE(value, 0);
+        total += value;
+    }
+    EXPECT_EQ(total, 100 * accounts);
+}
@@ -134,4 +134,232 @@ TEST(ConsistentMapTest, RandomStepsInvalidate) {
         }
         EXPECT_TRUE(map.contains(it->first));
     }
-}
\ No newline at end of file
+}
+
+TEST(ConsistentMapTest, EraseThroughStaleIterator) {
+    polyndrom::acid_map<int, int> map;
+    for (int i = 0; i < 10; i++) {
+        map.emplace(i, i);
+    }
+    auto stale = map.find(5);
+    map.erase(5);
+    map.emplace(5, 50);
+    auto next = map.erase(stale);
+    EXPECT_EQ(map.size(), 10);
+    EXPECT_TRUE(map.contains(5));
+    EXPECT_EQ(map.find(5)->second, 50);
+    EXPECT_EQ(next->first, 6);
+}
+
+TEST(ConsistentMapTest, ClearWithErasedIterators) {
+    int n = 10000;
+    polyndrom::acid_map<int, int> map;
+    std::vector<decltype(map.begin())> its;
+    its.reserve(n);
+    for (int i = 0; i < n; i++) {
+        its.push_back(map.emplace(i, i).first);
+    }
+    for (int i = 0; i < n; i += 3) {
+        map.erase(its[i]);
+    }
+    map.clear();
+    EXPECT_EQ(map.size(), 0);
+    EXPECT_EQ(map.begin(), map.end());
+    for (auto it : its) {
+        auto it2 = it;
+        ++it;
+        --it2;
+        EXPECT_EQ(it, map.end());
+        EXPECT_EQ(it2, map.end());
+    }
+    for (int i = 0; i < n; i++) {
+        map.emplace(i, i);
+    }
+    EXPECT_EQ(map.size(), n);
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+}
+
+TEST(ConsistentMapTest, EraseManyWithLiveIterators) {
+    int n = 10000;
+    polyndrom::acid_map<int, int> map;
+    std::vector<decltype(map.begin())> its;
+    for (int i = 0; i < n; i++) {
+        its.push_back(map.emplace(i, i).first);
+    }
+    for (int i = 0; i < n; i += 5) {
+        map.erase(its[i]);
+    }
+    std::vector<int> keys;
+    for (int i = 0; i < n; i++) {
+        if (i % 3 != 0) {
+            keys.push_back(i);
+        }
+    }
+    map.erase_many(keys.begin(), keys.end());
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+    for (int i = 0; i < n; i++) {
+        auto it = its[i];
+        ++it;
+        if (it != map.end()) {
+            EXPECT_TRUE(map.contains(it->first));
+            EXPECT_EQ(it->first % 3, 0);
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        EXPECT_EQ(map.contains(i), i % 3 == 0 && i % 5 != 0);
+    }
+    its.clear();
+    map.clear();
+    EXPECT_EQ(map.size(), 0);
+}
+
+TEST(ConsistentMapTest, RangeWithErasedBounds) {
+    polyndrom::acid_map<int, int> map;
+    for (int i = 0; i < 1000; i++) {
+        map.emplace(i, i);
+    }
+    auto range = map.range(100, 200);
+    int visited = 0;
+    for (auto it = range.begin(); it != range.end(); ++it) {
+        if (it->first == 100) {
+            map.erase(200);
+            map.erase(150);
+        }
+        EXPECT_LT(it->first, 200);
+        ++visited;
+    }
+    EXPECT_EQ(visited, 99);
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+}
+
+TEST(ConsistentMapTest, OrderStatisticsOfErasedIterators) {
+    polyndrom::acid_map<int, int> map;
+    for (int i = 0; i < 1000; i++) {
+        map.emplace(i, i);
+    }
+    auto it = map.find(500);
+    map.erase(it);
+    EXPECT_EQ(map.rank(it), 500);
+    auto next = it;
+    ++next;
+    EXPECT_EQ(it + 1, next);
+    EXPECT_EQ((it + 3)->first, next->first + 2);
+    std::vector<int> keys = {400, 600};
+    map.erase_many(keys.begin(), keys.end());
+    EXPECT_EQ(map.rank(it), 499);
+    EXPECT_EQ(map.rank(map.find(700)), 697);
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+}
+
+TEST(ConsistentMapTest, RangeEraseWithLiveIterators) {
+    using pool_allocator = polyndrom::node_pool_allocator<std::pair<const int, int>>;
+    pool_allocator allocator;
+    {
+        polyndrom::acid_map<int, int, std::less<int>, pool_allocator> map(allocator);
+        std::vector<decltype(map.begin())> its;
+        for (int i = 0; i < 1000; i++) {
+            its.push_back(map.emplace(i, i).first);
+        }
+        map.erase(its[300]);
+        map.erase(its[301]);
+        map.erase(map.find(200), map.find(400));
+        EXPECT_EQ(map.size(), 800);
+        EXPECT_TRUE(polyndrom::verify_tree(map));
+        for (int i = 200; i < 400; i++) {
+            auto it = its[i];
+            EXPECT_EQ(it->first, i);
+            ++it;
+            EXPECT_EQ(it->first, 400);
+        }
+        decltype(map) upper(allocator);
+        map.split(500, upper);
+        auto it = its[499];
+        ++it;
+        EXPECT_EQ(it, map.end());
+        it = its[500];
+        ++it;
+        EXPECT_EQ(it->first, 501);
+        upper.erase(upper.begin(), upper.end());
+        EXPECT_EQ(its[700]->first, 700);
+        ++its[700];
+        EXPECT_EQ(its[700], upper.end());
+        its.clear();
+        it = map.end();
+        EXPECT_EQ(allocator.in_use(), map.size());
+    }
+    EXPECT_EQ(allocator.in_use(), 0);
+}
+
+TEST(ConsistentMapTest, MovedNodesFollowTheirMap) {
+    polyndrom::acid_map<int, int> joined;
+    decltype(joined.begin()) rejoined;
+    {
+        polyndrom::acid_map<int, int> map;
+        for (int i = 0; i < 1000; i++) {
+            map.emplace(i, i);
+        }
+        auto moved = map.find(600);
+        rejoined = map.find(800);
+        polyndrom::acid_map<int, int> upper;
+        map.split(500, upper);
+        upper.erase(600);
+        ++moved;
+        EXPECT_EQ(moved->first, 601);
+        upper.extract_range(700, 1000, joined);
+        moved = upper.end();
+    }
+    joined.erase(800);
+    --rejoined;
+    EXPECT_EQ(rejoined->first, 799);
+    EXPECT_EQ(std::distance(joined.begin(), rejoined), 99);
+    rejoined = joined.end();
+}
+
+TEST(ConsistentMapTest, ErasedNodesRetainOnlyThemselves) {
+    using pool_allocator = polyndrom::node_pool_allocator<std::pair<const int, int>>;
+    pool_allocator allocator;
+    {
+        polyndrom::acid_map<int, int, std::less<int>, pool_allocator> map(allocator);
+        std::vector<decltype(map.begin())> its;
+        int n = 10000;
+        for (int i = 0; i < n; i++) {
+            map.emplace(i, i);
+        }
+        for (int i = 0; i < n; i += 100) {
+            its.push_back(map.find(i));
+        }
+        // Churn that keeps erasing the elements next to the parked iterators and their old ancestors.
+        int_generator generator(0, n - 1);
+        size_t most_retained = 0;
+        for (int round = 0; round < 20; round++) {
+            for (int i = 0; i < n; i++) {
+                int key = generator.next_value();
+                if (!map.erase(key)) {
+                    map.emplace(key, key);
+                }
+            }
+            for (int i = round % 2; i < n; i += 2) {
+                map.erase(i);
+            }
+            most_retained = std::max(most_retained, allocator.in_use() - map.size());
+        }
+        size_t retained_bytes = most_retained * sizeof(map_node<std::pair<const int, int>>);
+        RecordProperty("retained_bytes", static_cast<int>(retained_bytes));
+        EXPECT_LE(most_retained, its.size());
+        for (auto& it : its) {
+            auto previous = it;
+            ++it;
+            --previous;
+            if (it != map.end()) {
+                EXPECT_TRUE(map.contains(it->first));
+            }
+            if (previous != map.end()) {
+                EXPECT_TRUE(map.contains(previous->first));
+            }
+        }
+        EXPECT_TRUE(polyndrom::verify_tree(map));
+        its.clear();
+        EXPECT_EQ(allocator.in_use(), map.size());
+    }
+    EXPECT_EQ(allocator.in_use(), 0);
+}
@@ -2,6 +2,10 @@
 #include "tree_verifier.hpp"
 #include "utils.hpp"
 
+#include <atomic>
+#include <map>
+#include <set>
+
 #include "gtest/gtest.h"
 
 using std::cout;
@@ -201,11 +205,13 @@ TEST_F(FilledMapTest, EraseByIterator) {
     for (int i = 0; i <  test_config.at("EraseByIterator"); i++) {
         auto prev_size = map_.size();
         auto random_it = random_element(inserted_values_);
-        auto it = map_.begin();
-        std::advance(it, std::distance(inserted_values_.begin(), random_it));
-        it = map_.erase(it);
-        EXPECT_EQ(it->first, next(random_it)->first);
-        EXPECT_EQ(it->second, next(random_it)->second);
+        auto it = map_.erase(map_.nth(std::distance(inserted_values_.begin(), random_it)));
+        if (next(random_it) == inserted_values_.end()) {
+            EXPECT_EQ(it, map_.end());
+        } else {
+            EXPECT_EQ(it->first, next(random_it)->first);
+            EXPECT_EQ(it->second, next(random_it)->second);
+        }
         EXPECT_EQ(prev_size - 1, map_.size());
         inserted_values_.erase(random_it);
     }
@@ -349,4 +355,713 @@ TEST_F(FilledMapTest, IteratorReversePostfixMove) {
         EXPECT_EQ(prev_it->first, key);
         EXPECT_EQ(prev_it->second, value);
     }
-}
\ No newline at end of file
+}
+TEST(MapNodeTest, SmallNodeFitsCacheLine) {
+    EXPECT_LE(sizeof(map_node<std::pair<const int, int>>), 64);
+    EXPECT_LE(sizeof(map_node<std::pair<const int64_t, int64_t>>), 64);
+}
+
+template <class T>
+class counting_allocator : public std::allocator<T> {
+public:
+    template <class U>
+    struct rebind {
+        using other = counting_allocator<U>;
+    };
+    counting_allocator(size_t* allocations) : allocations(allocations) {}
+    template <class U>
+    counting_allocator(const counting_allocator<U>& other) : allocations(other.allocations) {}
+    T* allocate(size_t n) {
+        ++*allocations;
+        return std::allocator<T>::allocate(n);
+    }
+    size_t* allocations;
+};
+TEST(DefaultMapTest, EmplaceExistingDoesNotAllocate) {
+    size_t allocations = 0;
+    counting_allocator<std::pair<const std::string, int>> allocator(&allocations);
+    polyndrom::acid_map<std::string, int, std::less<std::string>, decltype(allocator)> map(allocator);
+    map.emplace("a", 1);
+    map.emplace(std::make_pair(std::string("b"), 2));
+    map.emplace(std::piecewise_construct, std::forward_as_tuple("c"), std::forward_as_tuple(3));
+    EXPECT_EQ(allocations, 3);
+    map.emplace(std::string("a"), 4);
+    map.emplace(std::make_pair(std::string("b"), 5));
+    map.emplace(std::piecewise_construct, std::forward_as_tuple("c"), std::forward_as_tuple(6));
+    map.try_emplace("a", 7);
+    map.insert(std::make_pair(std::string("b"), 8));
+    EXPECT_EQ(allocations, 3);
+    EXPECT_EQ(map.at("a"), 1);
+    EXPECT_EQ(map.at("b"), 2);
+    EXPECT_EQ(map.at("c"), 3);
+}
+TEST(DefaultMapTest, RandomInsertEraseKeepsHeights) {
+    polyndrom::acid_map<int, int> map;
+    int_generator generator(0, 2000);
+    for (int i = 0; i < 20000; i++) {
+        int key = generator.next_value();
+        if (i % 3 == 0) {
+            map.erase(key);
+        } else {
+            map.emplace(key, i);
+        }
+        if (i % 1000 == 0) {
+            ASSERT_TRUE(polyndrom::verify_tree(map));
+        }
+    }
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+}
+
+struct counting_three_way_compare {
+    bool operator()(const std::string& lhs, const std::string& rhs) const {
+        ++*less_calls;
+        return lhs < rhs;
+    }
+    int compare(const std::string& lhs, const std::string& rhs) const {
+        ++*compare_calls;
+        return lhs.compare(rhs);
+    }
+    size_t* less_calls;
+    size_t* compare_calls;
+};
+TEST(DefaultMapTest, ThreeWayComparatorComparesOncePerLevel) {
+    size_t less_calls = 0;
+    size_t compare_calls = 0;
+    polyndrom::acid_map<std::string, int, counting_three_way_compare> map(
+        counting_three_way_compare{&less_calls, &compare_calls});
+    string_generator generator(100, 100);
+    std::vector<std::string> keys;
+    for (int i = 0; i < 1000; i++) {
+        keys.push_back(generator.next_value());
+        map.emplace(keys.back(), i);
+    }
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+    less_calls = 0;
+    compare_calls = 0;
+    for (auto& key : keys) {
+        EXPECT_TRUE(map.contains(key));
+    }
+    EXPECT_EQ(less_calls, 0);
+    EXPECT_LE(compare_calls, keys.size() * 15);
+}
+
+struct difference_compare {
+    bool operator()(long long lhs, long long rhs) const {
+        return lhs < rhs;
+    }
+    long long compare(long long lhs, long long rhs) const {
+        return lhs - rhs;
+    }
+};
+TEST(DefaultMapTest, ThreeWayComparatorWithWideResult) {
+    polyndrom::acid_map<long long, int, difference_compare> map;
+    long long step = 1LL << 32;
+    for (int i = 0; i < 10; i++) {
+        map.emplace(i * step, i);
+    }
+    EXPECT_EQ(map.size(), 10);
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ(map.find(i * step)->second, i);
+    }
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+}
+TEST(DefaultMapTest, TransparentLookup) {
+    polyndrom::acid_map<std::string, int, std::less<>> map;
+    map.emplace("b", 2);
+    map.emplace("a", 1);
+    map.emplace("c", 3);
+    EXPECT_EQ(map.find(std::string_view("a"))->second, 1);
+    EXPECT_EQ(map.find("c")->second, 3);
+    EXPECT_EQ(map.count("d"), 0);
+}
+TEST(DefaultMapTest, AssignSortedBuildsBalancedTree) {
+    for (int n : {0, 1, 2, 3, 7, 8, 1000, 4097}) {
+        std::vector<std::pair<int, int>> values;
+        for (int i = 0; i < n; i++) {
+            values.emplace_back(2 * i, i);
+        }
+        polyndrom::acid_map<int, int> map(polyndrom::sorted_unique, values.begin(), values.end());
+        EXPECT_EQ(map.size(), n);
+        EXPECT_TRUE(polyndrom::verify_tree(map));
+        EXPECT_TRUE(std::equal(values.begin(), values.end(), map.begin(), map.end(),
+                               [](auto& lhs, auto& rhs) { return lhs.first == rhs.first && lhs.second == rhs.second; }));
+        map.emplace(-1, -1);
+        map.erase(0);
+        EXPECT_TRUE(polyndrom::verify_tree(map));
+    }
+}
+TEST(DefaultMapTest, AssignSortedSkipsDuplicatesAndRejectsUnsorted) {
+    polyndrom::acid_map<int, int> map;
+    std::vector<std::pair<int, int>> duplicates = {{1, 1}, {1, 2}, {2, 3}, {3, 4}, {3, 5}};
+    map.assign_sorted(duplicates.begin(), duplicates.end());
+    EXPECT_EQ(map.size(), 3);
+    EXPECT_EQ(map.at(1), 1);
+    EXPECT_EQ(map.at(3), 4);
+    std::vector<std::pair<int, int>> unsorted = {{1, 1}, {3, 3}, {2, 2}};
+    EXPECT_THROW(map.assign_sorted(unsorted.begin(), unsorted.end()), std::invalid_argument);
+    EXPECT_TRUE(map.empty());
+}
+TEST(DefaultMapTest, AssignUnsortedRange) {
+    std::vector<std::pair<complex_object, complex_object>> values;
+    complex_object_generator generator;
+    for (int i = 0; i < 1000; i++) {
+        values.emplace_back(generator.next_value(), generator.next_value());
+    }
+    polyndrom::acid_map<complex_object, complex_object> map(values.begin(), values.end());
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end(),
+                             [](auto& lhs, auto& rhs) { return lhs.first == rhs.first; }), values.end());
+    EXPECT_EQ(map.size(), values.size());
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+    auto it = map.begin();
+    for (auto& [key, value] : values) {
+        EXPECT_EQ(it->first, key);
+        ++it;
+    }
+}
+TEST(DefaultMapTest, InsertManyMatchesInsert) {
+    for (int batch_size : {10, 5000}) {
+        polyndrom::acid_map<int, int> map;
+        std::map<int, int> expected;
+        int_generator generator(0, 20000);
+        for (int i = 0; i < 10000; i++) {
+            int key = generator.next_value();
+            map.emplace(key, i);
+            expected.emplace(key, i);
+        }
+        std::vector<std::pair<int, int>> batch;
+        for (int i = 0; i < batch_size; i++) {
+            batch.emplace_back(generator.next_value(), -i);
+        }
+        batch.push_back(batch.front());
+        auto results = map.insert_many(batch.begin(), batch.end());
+        ASSERT_EQ(results.size(), batch.size());
+        for (size_t i = 0; i < batch.size(); i++) {
+            auto [it, inserted] = expected.insert(batch[i]);
+            EXPECT_EQ(results[i].second, inserted);
+            EXPECT_EQ(results[i].first->first, it->first);
+            EXPECT_EQ(results[i].first->second, it->second);
+        }
+        EXPECT_EQ(map.size(), expected.size());
+        EXPECT_TRUE(polyndrom::verify_tree(map));
+        EXPECT_TRUE(std::equal(map.begin(), map.end(), expected.begin(), expected.end(),
+                               [](auto& lhs, auto& rhs) { return lhs.first == rhs.first && lhs.second == rhs.second; }));
+    }
+}
+TEST(DefaultMapTest, EraseManyMatchesErase) {
+    for (int batch_size : {10, 5000}) {
+        polyndrom::acid_map<std::string, int> map;
+        std::map<std::string, int> expected;
+        string_generator generator(1, 3);
+        for (int i = 0; i < 10000; i++) {
+            std::string key = generator.next_value();
+            map.emplace(key, i);
+            expected.emplace(key, i);
+        }
+        std::vector<std::string> batch;
+        for (int i = 0; i < batch_size; i++) {
+            batch.push_back(generator.next_value());
+        }
+        batch.push_back(batch.front());
+        auto results = map.erase_many(batch.begin(), batch.end());
+        ASSERT_EQ(results.size(), batch.size());
+        for (size_t i = 0; i < batch.size(); i++) {
+            EXPECT_EQ(results[i], expected.erase(batch[i]));
+        }
+        EXPECT_EQ(map.size(), expected.size());
+        EXPECT_TRUE(polyndrom::verify_tree(map));
+        EXPECT_TRUE(std::equal(map.begin(), map.end(), expected.begin(), expected.end(),
+                               [](auto& lhs, auto& rhs) { return lhs.first == rhs.first; }));
+    }
+}
+TEST(DefaultMapTest, BatchOfContiguousKeys) {
+    polyndrom::acid_map<int, int> map;
+    std::vector<std::pair<int, int>> values;
+    for (int i = 0; i < 1000; i++) {
+        values.emplace_back(i * 1000, i);
+    }
+    map.insert_many(values.begin(), values.end());
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+    values.clear();
+    for (int i = 0; i < 5000; i++) {
+        values.emplace_back(500000 + i, i);
+    }
+    map.insert_many(values.begin(), values.end());
+    EXPECT_EQ(map.size(), 5995);
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+    std::vector<int> keys;
+    for (int i = 400000; i < 700000; i++) {
+        keys.push_back(i);
+    }
+    auto erased = map.erase_many(keys.begin(), keys.end());
+    EXPECT_EQ(std::count(erased.begin(), erased.end(), 1), 5295);
+    EXPECT_EQ(map.size(), 700);
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+    keys.clear();
+    for (auto& [key, value] : map) {
+        keys.push_back(key);
+    }
+    map.erase_many(keys.begin(), keys.end());
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(map.begin(), map.end());
+}
+TEST(DefaultMapTest, BoundsMatchStdMap) {
+    polyndrom::acid_map<int, int> map;
+    std::map<int, int> expected;
+    int_generator generator(0, 10000);
+    for (int i = 0; i < 2000; i++) {
+        int key = generator.next_value();
+        map.emplace(key, i);
+        expected.emplace(key, i);
+    }
+    auto same = [&](auto it, auto expected_it) {
+        if (expected_it == expected.end()) {
+            return it == map.end();
+        }
+        return it != map.end() && it->first == expected_it->first;
+    };
+    for (int key = -1; key <= 10001; key++) {
+        EXPECT_TRUE(same(map.lower_bound(key), expected.lower_bound(key)));
+        EXPECT_TRUE(same(map.upper_bound(key), expected.upper_bound(key)));
+        auto [first, last] = map.equal_range(key);
+        auto [expected_first, expected_last] = expected.equal_range(key);
+        EXPECT_TRUE(same(first, expected_first));
+        EXPECT_TRUE(same(last, expected_last));
+    }
+}
+TEST(DefaultMapTest, RangeScan) {
+    polyndrom::acid_map<int, int> map;
+    for (int i = 0; i < 1000; i += 2) {
+        map.emplace(i, i);
+    }
+    std::vector<int> keys;
+    for (auto& [key, value] : map.range(101, 201)) {
+        keys.push_back(key);
+    }
+    ASSERT_EQ(keys.size(), 50);
+    EXPECT_EQ(keys.front(), 102);
+    EXPECT_EQ(keys.back(), 200);
+    EXPECT_TRUE(map.range(101, 102).empty());
+    EXPECT_TRUE(map.range(300, 300).empty());
+    EXPECT_TRUE(map.range(2000, 3000).empty());
+    auto all = map.range(-10, 10000);
+    EXPECT_EQ(std::distance(all.begin(), all.end()), 500);
+}
+TEST(DefaultMapTest, TransparentBounds) {
+    polyndrom::acid_map<std::string, int, std::less<>> map;
+    for (std::string key : {"apple", "banana", "cherry", "date"}) {
+        map.emplace(key, 0);
+    }
+    std::string_view b = "b";
+    EXPECT_EQ(map.lower_bound(b)->first, "banana");
+    EXPECT_EQ(map.upper_bound(std::string_view("banana"))->first, "cherry");
+    std::vector<std::string> keys;
+    for (auto& [key, value] : map.range(std::string_view("b"), std::string_view("d"))) {
+        keys.push_back(key);
+    }
+    EXPECT_EQ(keys, std::vector<std::string>({"banana", "cherry"}));
+}
+TEST(DefaultMapTest, OrderStatistics) {
+    polyndrom::acid_map<int, int> map;
+    std::set<int> expected;
+    int_generator generator(0, 5000);
+    for (int i = 0; i < 20000; i++) {
+        int key = generator.next_value();
+        if (i % 3 == 0) {
+            map.erase(key);
+            expected.erase(key);
+        } else {
+            map.emplace(key, key);
+            expected.insert(key);
+        }
+    }
+    std::vector<int> sorted(expected.begin(), expected.end());
+    ASSERT_EQ(map.size(), sorted.size());
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+    for (size_t i = 0; i < sorted.size(); i++) {
+        auto it = map.nth(i);
+        EXPECT_EQ(it->first, sorted[i]);
+        EXPECT_EQ(map.rank(it), i);
+        EXPECT_EQ(map.rank(sorted[i]), i);
+        EXPECT_EQ(map.rank(sorted[i] + 1), i + 1);
+        EXPECT_EQ(it - map.begin(), static_cast<ptrdiff_t>(i));
+        EXPECT_EQ(map.end() - it, static_cast<ptrdiff_t>(sorted.size() - i));
+    }
+    EXPECT_EQ(map.nth(sorted.size()), map.end());
+    EXPECT_EQ(map.rank(map.end()), sorted.size());
+    auto it = map.begin();
+    it += 100;
+    EXPECT_EQ(it->first, sorted[100]);
+    it -= 50;
+    EXPECT_EQ(it->first, sorted[50]);
+    EXPECT_EQ((it + 10)->first, sorted[60]);
+    EXPECT_EQ((it - 50)->first, sorted[0]);
+    EXPECT_EQ(it - 51, map.end());
+    EXPECT_EQ(it + static_cast<ptrdiff_t>(sorted.size()), map.end());
+    ptrdiff_t size = static_cast<ptrdiff_t>(sorted.size());
+    EXPECT_EQ((map.end() - 1)->first, sorted.back());
+    EXPECT_EQ(map.end() - size, map.begin());
+    EXPECT_EQ(map.end() - (size + 1), map.end());
+    EXPECT_EQ(map.end() + 3, map.end());
+    EXPECT_EQ(std::prev(map.end(), 20)->first, sorted[sorted.size() - 20]);
+    auto back = map.end();
+    back -= 10;
+    EXPECT_EQ(back->first, sorted[sorted.size() - 10]);
+    back = map.end();
+    back += -size;
+    EXPECT_EQ(back, map.begin());
+    EXPECT_EQ(--map.end(), map.nth(sorted.size() - 1));
+}
+TEST(DefaultMapTest, SplitAndJoin) {
+    polyndrom::acid_map<int, int> map;
+    std::map<int, int> expected;
+    int_generator generator(0, 100000);
+    for (int i = 0; i < 20000; i++) {
+        int key = generator.next_value();
+        map.emplace(key, i);
+        expected.emplace(key, i);
+    }
+    for (int step = 0; step < 200; step++) {
+        int key = generator.next_value();
+        polyndrom::acid_map<int, int> upper;
+        map.split(key, upper);
+        EXPECT_TRUE(polyndrom::verify_tree(map));
+        EXPECT_TRUE(polyndrom::verify_tree(upper));
+        auto middle = expected.lower_bound(key);
+        EXPECT_EQ(map.size(), static_cast<size_t>(std::distance(expected.begin(), middle)));
+        EXPECT_TRUE(std::equal(map.begin(), map.end(), expected.begin(), middle));
+        EXPECT_TRUE(std::equal(upper.begin(), upper.end(), middle, expected.end()));
+        map.join(upper);
+        EXPECT_TRUE(upper.empty());
+        ASSERT_TRUE(polyndrom::verify_tree(map));
+        EXPECT_EQ(map.size(), expected.size());
+    }
+    polyndrom::acid_map<int, int> lower;
+    lower.emplace(-1, 0);
+    EXPECT_THROW(map.join(lower), std::invalid_argument);
+    EXPECT_THROW(lower.split(0, map), std::invalid_argument);
+    lower.join(map);
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(lower.size(), expected.size() + 1);
+    EXPECT_TRUE(polyndrom::verify_tree(lower));
+}
+TEST(DefaultMapTest, EraseAndExtractRanges) {
+    polyndrom::acid_map<int, int> map;
+    std::map<int, int> expected;
+    for (int i = 0; i < 20000; i++) {
+        map.emplace(i * 3, i);
+        expected.emplace(i * 3, i);
+    }
+    int_generator generator(0, 60000);
+    for (int step = 0; step < 100; step++) {
+        int lo = generator.next_value();
+        int hi = lo + generator.next_value() / 20;
+        if (step % 2 == 0) {
+            auto last = map.erase(map.lower_bound(lo), map.lower_bound(hi));
+            EXPECT_EQ(last, map.lower_bound(hi));
+            expected.erase(expected.lower_bound(lo), expected.lower_bound(hi));
+        } else {
+            polyndrom::acid_map<int, int> extracted;
+            map.extract_range(lo, hi, extracted);
+            EXPECT_TRUE(polyndrom::verify_tree(extracted));
+            auto first = expected.lower_bound(lo);
+            auto last = expected.lower_bound(hi);
+            EXPECT_TRUE(std::equal(extracted.begin(), extracted.end(), first, last));
+            expected.erase(first, last);
+        }
+        ASSERT_TRUE(polyndrom::verify_tree(map));
+        ASSERT_EQ(map.size(), expected.size());
+    }
+    EXPECT_TRUE(std::equal(map.begin(), map.end(), expected.begin(), expected.end()));
+    map.erase(map.begin(), map.end());
+    EXPECT_TRUE(map.empty());
+}
+TEST(DefaultMapTest, MoveHandsNodesToTheNewMap) {
+    static_assert(!std::is_copy_constructible_v<polyndrom::acid_map<int, int>>);
+    static_assert(!std::is_copy_assignable_v<polyndrom::acid_map<int, int>>);
+    polyndrom::acid_map<int, int> map;
+    for (int i = 0; i < 100; i++) {
+        map.emplace(i, i);
+    }
+    auto it = map.find(50);
+    polyndrom::acid_map<int, int> moved(std::move(map));
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(moved.size(), 100);
+    EXPECT_TRUE(polyndrom::verify_tree(moved));
+    moved.erase(50);
+    ++it;
+    EXPECT_EQ(it->first, 51);
+    polyndrom::acid_map<int, int> assigned;
+    assigned.emplace(-1, -1);
+    assigned = std::move(moved);
+    EXPECT_TRUE(moved.empty());
+    EXPECT_EQ(assigned.size(), 99);
+    assigned.erase(51);
+    ++it;
+    EXPECT_EQ(it->first, 52);
+    it = map.end();
+    map.emplace(1, 1);
+    EXPECT_EQ(map.size(), 1);
+}
+TEST(DefaultMapTest, SetOperationsMatchStdMap) {
+    int_generator generator(0, 60000);
+    auto fill = [&](polyndrom::acid_map<int, int>& map, std::map<int, int>& expected, int count) {
+        for (int i = 0; i < count; i++) {
+            int key = generator.next_value();
+            map.emplace(key, key);
+            expected.emplace(key, key);
+        }
+    };
+    polyndrom::work_stealing_pool workers(4);
+    polyndrom::work_stealing_pool* pools[] = {nullptr, &workers};
+    for (polyndrom::work_stealing_pool* pool : pools) {
+        polyndrom::acid_map<int, int> map;
+        polyndrom::acid_map<int, int> other;
+        std::map<int, int> expected;
+        std::map<int, int> expected_other;
+        fill(map, expected, 20000);
+        fill(other, expected_other, 30000);
+        map.unite(other, [](int& value, int added) {
+            value += added;
+        }, pool);
+        for (auto& [key, value] : expected_other) {
+            auto [it, inserted] = expected.emplace(key, value);
+            if (!inserted) {
+                it->second += value;
+            }
+        }
+        ASSERT_TRUE(polyndrom::verify_tree(map));
+        EXPECT_TRUE(std::equal(map.begin(), map.end(), expected.begin(), expected.end()));
+        EXPECT_TRUE(std::equal(other.begin(), other.end(), expected_other.begin(), expected_other.end()));
+        polyndrom::acid_map<int, int> filter;
+        std::map<int, int> expected_filter;
+        fill(filter, expected_filter, 25000);
+        map.intersect(filter, pool);
+        for (auto it = expected.begin(); it != expected.end();) {
+            it = expected_filter.count(it->first) == 1 ? std::next(it) : expected.erase(it);
+        }
+        ASSERT_TRUE(polyndrom::verify_tree(map));
+        EXPECT_TRUE(std::equal(map.begin(), map.end(), expected.begin(), expected.end()));
+        polyndrom::acid_map<int, int> removed;
+        std::map<int, int> expected_removed;
+        fill(removed, expected_removed, 25000);
+        map.subtract(removed, pool);
+        for (auto& [key, value] : expected_removed) {
+            expected.erase(key);
+        }
+        ASSERT_TRUE(polyndrom::verify_tree(map));
+        EXPECT_TRUE(std::equal(map.begin(), map.end(), expected.begin(), expected.end()));
+    }
+}
+TEST(DefaultMapTest, SetOperationKeepsMapOnFailedMerge) {
+    polyndrom::acid_map<int, int> map;
+    polyndrom::acid_map<int, int> other;
+    polyndrom::work_stealing_pool workers(4);
+    for (int i = 0; i < 10000; i++) {
+        map.emplace(i * 2, i);
+        other.emplace(i * 3, i);
+    }
+    map.erase(6);
+    EXPECT_THROW(map.unite(other, [](int&, int added) {
+        if (added % 100 == 0) {
+            throw std::runtime_error("merge failed");
+        }
+    }, &workers), std::runtime_error);
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+    EXPECT_EQ(map.size(), 9999 + 10000 - 3333);
+    EXPECT_TRUE(map.contains(6));
+    auto it = map.find(12);
+    map.subtract(other);
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+    EXPECT_EQ(map.size(), 10000 - 3334);
+    EXPECT_EQ(it->first, 12);
+    ++it;
+    EXPECT_EQ(it->first, 14);
+}
+// Throws on any comparison with the key 777 while armed.
+struct throwing_less {
+    static inline std::atomic<bool> armed = false;
+    bool operator()(int lhs, int rhs) const {
+        if (armed && (lhs == 777 || rhs == 777)) {
+            throw std::runtime_error("compare failed");
+        }
+        return lhs < rhs;
+    }
+};
+TEST(DefaultMapTest, SetOperationSurvivesThrowingComparator) {
+    polyndrom::work_stealing_pool workers(4);
+    polyndrom::work_stealing_pool* pools[] = {nullptr, &workers};
+    for (polyndrom::work_stealing_pool* pool : pools) {
+        polyndrom::acid_map<int, int, throwing_less> map;
+        polyndrom::acid_map<int, int, throwing_less> other;
+        for (int i = 0; i < 10000; i++) {
+            map.emplace(i * 2, i);
+            other.emplace(i * 3, i);
+        }
+        throwing_less::armed = true;
+        EXPECT_THROW(map.unite(other, [](int&, int) {}, pool), std::runtime_error);
+        throwing_less::armed = false;
+        EXPECT_TRUE(polyndrom::verify_tree(map));
+        EXPECT_EQ(static_cast<size_t>(std::distance(map.begin(), map.end())), map.size());
+        for (int i = 0; i < 10000; i++) {
+            EXPECT_TRUE(map.contains(i * 2));
+        }
+        EXPECT_FALSE(map.contains(777));
+        size_t united = map.size();
+        throwing_less::armed = true;
+        EXPECT_THROW(map.subtract(other, pool), std::runtime_error);
+        throwing_less::armed = false;
+        EXPECT_TRUE(polyndrom::verify_tree(map));
+        EXPECT_EQ(static_cast<size_t>(std::distance(map.begin(), map.end())), map.size());
+        EXPECT_LT(map.size(), united);
+        EXPECT_FALSE(map.contains(0));
+    }
+}
+
+// Walks the map both ways through its iterators, which use the successor and predecessor links of threaded maps.
+template <class Map>
+void expect_iterates_like(Map& map, const std::map<int, int>& expected) {
+    ASSERT_TRUE(polyndrom::verify_tree(map));
+    EXPECT_TRUE(std::equal(map.begin(), map.end(), expected.begin(), expected.end()));
+    if (expected.empty()) {
+        return;
+    }
+    auto it = map.nth(map.size() - 1);
+    for (auto expected_it = expected.rbegin(); expected_it != expected.rend(); ++expected_it, --it) {
+        ASSERT_NE(it, map.end());
+        ASSERT_EQ(it->first, expected_it->first);
+    }
+    EXPECT_EQ(it, map.end());
+}
+TEST(ThreadedMapTest, LinksFollowEveryUpdate) {
+    polyndrom::threaded_acid_map<int, int> map;
+    std::map<int, int> expected;
+    int_generator generator(0, 60000);
+    for (int i = 0; i < 20000; i++) {
+        int key = generator.next_value();
+        if (i % 3 == 0) {
+            EXPECT_EQ(map.erase(key), expected.erase(key));
+        } else {
+            EXPECT_EQ(map.emplace(key, key).second, expected.emplace(key, key).second);
+        }
+    }
+    expect_iterates_like(map, expected);
+    std::vector<std::pair<int, int>> batch;
+    std::vector<int> keys;
+    for (int i = 0; i < 5000; i++) {
+        int key = generator.next_value();
+        batch.emplace_back(key, key);
+        keys.push_back(generator.next_value());
+    }
+    map.insert_many(batch.begin(), batch.end());
+    expected.insert(batch.begin(), batch.end());
+    expect_iterates_like(map, expected);
+    map.erase_many(keys.begin(), keys.begin() + 100);
+    map.erase_many(keys.begin() + 100, keys.end());
+    for (int key : keys) {
+        expected.erase(key);
+    }
+    expect_iterates_like(map, expected);
+    map.erase(map.lower_bound(10000), map.lower_bound(20000));
+    expected.erase(expected.lower_bound(10000), expected.lower_bound(20000));
+    expect_iterates_like(map, expected);
+    polyndrom::threaded_acid_map<int, int> extracted;
+    map.extract_range(30000, 40000, extracted);
+    expected.erase(expected.lower_bound(30000), expected.lower_bound(40000));
+    expect_iterates_like(map, expected);
+    polyndrom::threaded_acid_map<int, int> upper;
+    map.split(25000, upper);
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+    EXPECT_TRUE(polyndrom::verify_tree(upper));
+    map.join(upper);
+    expect_iterates_like(map, expected);
+    polyndrom::threaded_acid_map<int, int> other;
+    for (int i = 0; i < 20000; i++) {
+        other.emplace(generator.next_value(), 0);
+    }
+    polyndrom::work_stealing_pool workers(4);
+    polyndrom::work_stealing_pool* pools[] = {nullptr, &workers};
+    for (polyndrom::work_stealing_pool* pool : pools) {
+        map.unite(other, [](int&, int) {}, pool);
+        for (auto& [key, value] : other) {
+            expected.emplace(key, value);
+        }
+        expect_iterates_like(map, expected);
+    }
+    polyndrom::threaded_acid_map<int, int> filter(expected.begin(), expected.end());
+    filter.erase_many(keys.begin(), keys.end());
+    filter.erase(filter.begin(), filter.lower_bound(5000));
+    map.intersect(filter);
+    for (auto it = expected.begin(); it != expected.end();) {
+        it = filter.contains(it->first) ? std::next(it) : expected.erase(it);
+    }
+    expect_iterates_like(map, expected);
+    map.subtract(other, &workers);
+    for (auto& [key, value] : other) {
+        expected.erase(key);
+    }
+    expect_iterates_like(map, expected);
+    map.assign(batch.begin(), batch.end());
+    expected = std::map<int, int>(batch.begin(), batch.end());
+    expect_iterates_like(map, expected);
+}
+TEST(ThreadedMapTest, ErasedNodesStepLikeUnthreaded) {
+    polyndrom::acid_map<int, int> plain;
+    polyndrom::threaded_acid_map<int, int> threaded;
+    for (int i = 0; i < 1000; i++) {
+        plain.emplace(i, i);
+        threaded.emplace(i, i);
+    }
+    std::vector<polyndrom::acid_map<int, int>::iterator> plain_its;
+    std::vector<polyndrom::threaded_acid_map<int, int>::iterator> threaded_its;
+    for (int i = 0; i < 1000; i += 7) {
+        plain_its.push_back(plain.find(i));
+        threaded_its.push_back(threaded.find(i));
+    }
+    for (int i = 0; i < 1000; i += 2) {
+        plain.erase(i);
+        threaded.erase(i);
+    }
+    for (size_t i = 0; i < plain_its.size(); i++) {
+        auto plain_next = std::next(plain_its[i]);
+        auto threaded_next = std::next(threaded_its[i]);
+        ASSERT_EQ(plain_next == plain.end(), threaded_next == threaded.end());
+        if (plain_next != plain.end()) {
+            EXPECT_EQ(plain_next->first, threaded_next->first);
+        }
+    }
+}
+TEST(ThreadedMapTest, RangeEraseFromErasedBounds) {
+    polyndrom::threaded_acid_map<int, int> map;
+    std::map<int, int> expected;
+    for (int i = 0; i < 1000; i++) {
+        map.emplace(i, i);
+        expected.emplace(i, i);
+    }
+    auto first = map.find(100);
+    auto last = map.find(200);
+    map.erase(100);
+    map.erase(first, last);
+    expected.erase(expected.lower_bound(100), expected.lower_bound(200));
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+    expect_iterates_like(map, expected);
+    first = map.find(300);
+    last = map.find(400);
+    map.erase(400);
+    map.erase(first, last);
+    expected.erase(expected.lower_bound(300), expected.upper_bound(400));
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+    expect_iterates_like(map, expected);
+    first = map.find(500);
+    last = map.find(600);
+    map.erase(500);
+    map.erase(600);
+    map.erase(first, last);
+    expected.erase(expected.lower_bound(500), expected.upper_bound(600));
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+    expect_iterates_like(map, expected);
+    map.erase(map.find(700), map.end());
+    expected.erase(expected.lower_bound(700), expected.end());
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+    expect_iterates_like(map, expected);
+}
@@ -0,0 +1,176 @@
+#include "durable_acid_map.hpp"
+#include "utils.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+class DurableMapTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        path_ = (std::filesystem::temp_directory_path() /
+                 ("durable_map_test_" + std::to_string(::getpid()) + "_" +
+                  ::testing::UnitTest::GetInstance()->current_test_info()->name() + ".wal")).string();
+        std::filesystem::remove(path_);
+    }
+    void TearDown() override {
+        std::filesystem::remove(path_);
+    }
+    std::string path_;
+};
+
+// Throws from the next comparisons while failures is positive.
+struct failing_less {
+    static inline int failures = 0;
+    bool operator()(int lhs, int rhs) const {
+        if (failures > 0) {
+            failures--;
+            throw std::runtime_error("Comparison failed");
+        }
+        return lhs < rhs;
+    }
+};
+
+TEST_F(DurableMapTest, ReplaysWritesOnOpen) {
+    std::map<std::string, int> expected;
+    for (auto level : {polyndrom::durability::sync, polyndrom::durability::group, polyndrom::durability::async}) {
+        polyndrom::durable_acid_map<std::string, int> map(path_, level, 4);
+        EXPECT_EQ(map.size(), expected.size());
+        string_generator generator(1, 3);
+        for (int i = 0; i < 500; i++) {
+            std::string key = generator.next_value();
+            switch (i % 3) {
+                case 0:
+                    EXPECT_EQ(map.erase(key), expected.erase(key));
+                    break;
+                case 1:
+                    EXPECT_EQ(map.try_emplace(key, i), expected.try_emplace(key, i).second);
+                    break;
+                default:
+                    EXPECT_EQ(map.insert_or_assign(key, i), expected.insert_or_assign(key, i).second);
+            }
+        }
+    }
+    polyndrom::durable_acid_map<std::string, int> map(path_);
+    EXPECT_EQ(map.size(), expected.size());
+    for (auto& [key, value] : expected) {
+        EXPECT_TRUE(map.cvisit(key, [&](const auto& element) {
+            EXPECT_EQ(element.second, value);
+        }));
+    }
+}
+TEST_F(DurableMapTest, DropsTornTail) {
+    {
+        polyndrom::durable_acid_map<int, int> map(path_, polyndrom::durability::sync);
+        for (int i = 0; i < 10; i++) {
+            map.insert_or_assign(i, i);
+        }
+    }
+    auto intact = std::filesystem::file_size(path_);
+    {
+        std::ofstream out(path_, std::ios::binary | std::ios::app);
+        out.write("\x09\x00\x00\x00garbage", 11);
+    }
+    {
+        polyndrom::durable_acid_map<int, int> map(path_, polyndrom::durability::sync);
+        EXPECT_EQ(map.size(), 10);
+        EXPECT_EQ(std::filesystem::file_size(path_), intact);
+        map.erase(0);
+    }
+    polyndrom::durable_acid_map<int, int> map(path_);
+    EXPECT_EQ(map.size(), 9);
+    EXPECT_FALSE(map.contains(0));
+}
+TEST_F(DurableMapTest, GroupCommitFromManyThreads) {
+    int threads = 8;
+    int per_thread = 200;
+    {
+        polyndrom::durable_acid_map<int, int> map(path_, polyndrom::durability::group);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t] {
+                for (int i = 0; i < per_thread; i++) {
+                    map.insert_or_assign(i % 50, t);
+                    map.insert_or_assign(1000 + t * per_thread + i, i);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        EXPECT_EQ(map.size(), 50 + threads * per_thread);
+        std::map<int, int> before;
+        for (auto& [key, value] : map) {
+            before.emplace(key, value);
+        }
+        std::filesystem::remove(path_ + ".copy");
+        std::filesystem::copy_file(path_, path_ + ".copy");
+        polyndrom::durable_acid_map<int, int> copy(path_ + ".copy");
+        std::map<int, int> after;
+        for (auto& [key, value] : copy) {
+            after.emplace(key, value);
+        }
+        EXPECT_EQ(before, after);
+        std::filesystem::remove(path_ + ".copy");
+    }
+}
+TEST_F(DurableMapTest, CompactsLog) {
+    std::map<int, int> expected;
+    {
+        polyndrom::durable_acid_map<int, int> map(path_, polyndrom::durability::async);
+        for (int i = 0; i < 20000; i++) {
+            map.insert_or_assign(i % 100, i);
+            expected.insert_or_assign(i % 100, i);
+        }
+    }
+    size_t uncompacted = std::filesystem::file_size(path_);
+    EXPECT_GT(uncompacted, size_t(1) << 16);
+    {
+        polyndrom::durable_acid_map<int, int> map(path_, polyndrom::durability::sync);
+        EXPECT_EQ(map.size(), expected.size());
+        map.compact();
+        EXPECT_LT(map.log_size(), uncompacted / 100);
+        EXPECT_EQ(std::filesystem::file_size(path_), map.log_size());
+        map.erase(0);
+        expected.erase(0);
+    }
+    {
+        polyndrom::durable_acid_map<int, int> map(path_, polyndrom::durability::group, 4, 4096);
+        for (int i = 0; i < 20000; i++) {
+            map.insert_or_assign(i % 100, -i);
+            expected.insert_or_assign(i % 100, -i);
+        }
+        EXPECT_LT(map.log_size(), size_t(8192));
+    }
+    polyndrom::durable_acid_map<int, int> map(path_);
+    std::map<int, int> replayed;
+    for (auto& [key, value] : map) {
+        replayed.emplace(key, value);
+    }
+    EXPECT_EQ(replayed, expected);
+    EXPECT_FALSE(std::filesystem::exists(path_ + ".tmp"));
+}
+TEST_F(DurableMapTest, LogsTheMapWhenAWriteFails) {
+    {
+        polyndrom::durable_acid_map<int, int, failing_less> map(path_, polyndrom::durability::sync, 1);
+        map.insert_or_assign(1, 1);
+        map.insert_or_assign(2, 2);
+        failing_less::failures = 1;
+        EXPECT_THROW(map.try_emplace(3, 3), std::runtime_error);
+        failing_less::failures = 1;
+        EXPECT_THROW(map.insert_or_assign(1, 10), std::runtime_error);
+        failing_less::failures = 1;
+        EXPECT_THROW(map.erase(2), std::runtime_error);
+        EXPECT_EQ(map.size(), 2);
+    }
+    polyndrom::durable_acid_map<int, int, failing_less> map(path_);
+    std::map<int, int> replayed;
+    for (auto& [key, value] : map) {
+        replayed.emplace(key, value);
+    }
+    EXPECT_EQ(replayed, (std::map<int, int>{{1, 1}, {2, 2}}));
+}
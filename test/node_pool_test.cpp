@@ -0,0 +1,128 @@
+#include "acid_map.hpp"
+#include "tree_verifier.hpp"
+#include "utils.hpp"
+
+#include "gtest/gtest.h"
+
+template <class Key, class T>
+using pooled_map = polyndrom::acid_map<Key, T, std::less<Key>, polyndrom::node_pool_allocator<std::pair<const Key, T>>>;
+
+TEST(NodePoolTest, ReusesFreedBlocks) {
+    polyndrom::node_pool pool;
+    void* first = pool.allocate(40, 8);
+    void* second = pool.allocate(40, 8);
+    EXPECT_NE(first, second);
+    EXPECT_EQ(pool.in_use(), 2);
+    pool.deallocate(first, 40, 8);
+    EXPECT_EQ(pool.allocate(40, 8), first);
+    pool.deallocate(first, 40, 8);
+    pool.deallocate(second, 40, 8);
+    EXPECT_EQ(pool.in_use(), 0);
+}
+
+TEST(NodePoolTest, OversizedBlocksBypassSlabs) {
+    polyndrom::node_pool pool;
+    void* block = pool.allocate(polyndrom::node_pool::max_block_size + 1, 8);
+    EXPECT_EQ(pool.in_use(), 1);
+    pool.deallocate(block, polyndrom::node_pool::max_block_size + 1, 8);
+    EXPECT_EQ(pool.in_use(), 0);
+}
+
+TEST(NodePoolTest, PooledMapMatchesDefaultMap) {
+    int n = 10000;
+    pooled_map<int, int> map;
+    int_generator generator(0, n);
+    std::vector<int> keys;
+    for (int i = 0; i < n; i++) {
+        int key = generator.next_value();
+        if (map.emplace(key, i).second) {
+            keys.push_back(key);
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    EXPECT_TRUE(std::equal(keys.begin(), keys.end(), map.begin(), map.end(),
+                           [](int key, auto& kv) { return key == kv.first; }));
+    for (size_t i = 0; i < keys.size(); i += 2) {
+        EXPECT_EQ(map.erase(keys[i]), 1);
+    }
+    EXPECT_EQ(map.size(), keys.size() / 2);
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+}
+
+TEST(NodePoolTest, ClearKeepsIteratorsAlive) {
+    int n = 10000;
+    pooled_map<int, std::string> map;
+    std::vector<decltype(map.begin())> its;
+    for (int i = 0; i < n; i++) {
+        its.push_back(map.emplace(i, std::to_string(i)).first);
+    }
+    map.clear();
+    for (auto it : its) {
+        ++it;
+        EXPECT_EQ(it, map.end());
+    }
+    its.clear();
+    for (int i = 0; i < n; i++) {
+        map.emplace(i, std::to_string(i));
+    }
+    EXPECT_EQ(map.size(), n);
+    EXPECT_TRUE(polyndrom::verify_tree(map));
+}
+
+TEST(NodePoolTest, DestroysNonTrivialValues) {
+    pooled_map<std::string, std::string> map;
+    string_generator generator(100, 100);
+    for (int i = 0; i < 1000; i++) {
+        map.try_emplace(generator.next_value(), generator.next_value());
+    }
+    map.clear();
+    for (int i = 0; i < 1000; i++) {
+        map.try_emplace(generator.next_value(), generator.next_value());
+    }
+}
+
+TEST(NodePoolTest, MoveAssignBetweenPools) {
+    using pool_allocator = polyndrom::node_pool_allocator<std::pair<const int, int>>;
+    pool_allocator source_allocator;
+    pool_allocator target_allocator;
+    pooled_map<int, int> target(target_allocator);
+    {
+        pooled_map<int, int> source(source_allocator);
+        for (int i = 0; i < 1000; i++) {
+            source.emplace(i, -i);
+        }
+        target.emplace(-1, 1);
+        target = std::move(source);
+        EXPECT_TRUE(source.empty());
+    }
+    EXPECT_EQ(source_allocator.in_use(), 0);
+    EXPECT_EQ(target_allocator.in_use(), 1000);
+    EXPECT_EQ(target.size(), 1000);
+    EXPECT_EQ(target.begin()->second, 0);
+    EXPECT_EQ(std::prev(target.end())->second, -999);
+    EXPECT_TRUE(polyndrom::verify_tree(target));
+}
+
+TEST(NodePoolTest, MapOwnsThePoolOfACopiedAllocator) {
+    using pool_allocator = polyndrom::node_pool_allocator<std::pair<const int, int>>;
+    pool_allocator allocator;
+    EXPECT_FALSE(allocator.owns_pool());
+    {
+        pooled_map<int, int> map(allocator);
+        for (int i = 0; i < 1000; i++) {
+            map.emplace(i, i);
+        }
+        EXPECT_TRUE(allocator.owns_pool());
+        {
+            pooled_map<int, int> other(allocator);
+            EXPECT_FALSE(allocator.owns_pool());
+            pooled_map<int, int> moved(std::move(other));
+        }
+        EXPECT_TRUE(allocator.owns_pool());
+        map.clear();
+        EXPECT_EQ(allocator.in_use(), 0);
+        map.emplace(1, 1);
+    }
+    EXPECT_FALSE(allocator.owns_pool());
+    EXPECT_EQ(allocator.in_use(), 0);
+}
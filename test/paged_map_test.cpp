@@ -0,0 +1,115 @@
+#include "paged_acid_map.hpp"
+#include "utils.hpp"
+
+#include <filesystem>
+#include <map>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+class PagedMapTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        path_ = (std::filesystem::temp_directory_path() /
+                 ("paged_map_test_" + std::to_string(::getpid()) + "_" +
+                  ::testing::UnitTest::GetInstance()->current_test_info()->name() + ".pages")).string();
+        std::filesystem::remove(path_);
+    }
+    void TearDown() override {
+        std::filesystem::remove(path_);
+    }
+    std::string path_;
+};
+
+template <class Map, class Expected>
+void expect_same(const Map& map, const Expected& expected) {
+    EXPECT_EQ(map.size(), expected.size());
+    auto expected_it = expected.begin();
+    for (auto& [key, value] : map) {
+        ASSERT_NE(expected_it, expected.end());
+        EXPECT_EQ(key, expected_it->first);
+        EXPECT_EQ(value, expected_it->second);
+        ++expected_it;
+    }
+    EXPECT_EQ(expected_it, expected.end());
+    auto expected_reverse = expected.rbegin();
+    for (auto it = map.end(); it != map.begin();) {
+        --it;
+        ASSERT_NE(expected_reverse, expected.rend());
+        EXPECT_EQ(it->first, expected_reverse->first);
+        ++expected_reverse;
+    }
+    EXPECT_EQ(expected_reverse, expected.rend());
+}
+
+TEST_F(PagedMapTest, MatchesStdMapWithSmallPool) {
+    polyndrom::paged_acid_map<int, int> map(path_, 16, std::less<int>(), 256);
+    std::vector<int> keys;
+    for (int key = 0; key <= 20000; key++) {
+        keys.push_back(key);
+    }
+    expect_matches_std_map(map, keys, 60000, keys);
+    EXPECT_GT(map.pages().pages(), map.pages().capacity());
+    EXPECT_GT(map.pages().counters().writes, 0);
+}
+TEST_F(PagedMapTest, ReopensFromFile) {
+    std::map<int, double> expected;
+    {
+        polyndrom::paged_acid_map<int, double> map(path_, 8);
+        for (int i = 0; i < 20000; i++) {
+            map.emplace(i * 7 % 20011, i * 0.5);
+            expected.emplace(i * 7 % 20011, i * 0.5);
+        }
+        for (int i = 0; i < 20000; i += 3) {
+            map.erase(i);
+            expected.erase(i);
+        }
+    }
+    {
+        polyndrom::paged_acid_map<int, double> map(path_, 8);
+        expect_same(map, expected);
+        map.clear();
+        EXPECT_TRUE(map.empty());
+        EXPECT_EQ(map.begin(), map.end());
+        map.emplace(1, 1.0);
+    }
+    polyndrom::paged_acid_map<int, double> map(path_, 8);
+    expect_same(map, std::map<int, double>{{1, 1.0}});
+    EXPECT_THROW((polyndrom::paged_acid_map<int64_t, double>(path_, 8)), std::runtime_error);
+}
+TEST_F(PagedMapTest, IteratorsSurviveModifications) {
+    int n = 10000;
+    polyndrom::paged_acid_map<int, int> map(path_, 16, std::less<int>(), 512);
+    std::vector<decltype(map.begin())> its;
+    for (int i = 0; i < n; i += 2) {
+        its.push_back(map.emplace(i, i).first);
+    }
+    for (int i = 1; i < n; i += 2) {
+        map.emplace(i, -i);
+    }
+    for (auto& it : its) {
+        EXPECT_EQ(it->first, it->second);
+        auto next = std::next(it);
+        EXPECT_EQ(next->first, it->first + 1);
+    }
+    for (size_t i = 0; i < its.size(); i++) {
+        auto it = its[i];
+        int key = it->first;
+        map.erase(it);
+        EXPECT_EQ(it->first, key);
+        EXPECT_FALSE(map.contains(key));
+        auto next = std::next(it);
+        if (key + 1 < n) {
+            EXPECT_EQ(next->first, key + 1);
+        } else {
+            EXPECT_EQ(next, map.end());
+        }
+        if (key > 0) {
+            EXPECT_EQ(std::prev(it)->first, key - 1);
+        }
+    }
+    auto last = std::prev(map.end());
+    map.clear();
+    EXPECT_EQ(std::next(last), map.end());
+    EXPECT_EQ(std::prev(last), map.end());
+}
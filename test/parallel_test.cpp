@@ -0,0 +1,144 @@
+#include "acid_map.hpp"
+#include "parallel.hpp"
+#include "utils.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+// Sums [first, last) by splitting it in halves down to single values, which makes nested forks.
+int64_t fork_sum(polyndrom::work_stealing_pool& pool, int64_t first, int64_t last) {
+    if (last - first <= 16) {
+        int64_t sum = 0;
+        for (int64_t value = first; value < last; value++) {
+            sum += value;
+        }
+        return sum;
+    }
+    int64_t middle = first + (last - first) / 2;
+    int64_t left = 0;
+    int64_t right = 0;
+    pool.fork_join([&] {
+        left = fork_sum(pool, first, middle);
+    }, [&] {
+        right = fork_sum(pool, middle, last);
+    });
+    return left + right;
+}
+
+TEST(ParallelTest, PoolRunsNestedForks) {
+    for (size_t threads : {1, 2, 4}) {
+        polyndrom::work_stealing_pool pool(threads);
+        EXPECT_EQ(pool.size(), threads);
+        int64_t sum = 0;
+        pool.run([&] {
+            sum = fork_sum(pool, 0, 100000);
+        });
+        EXPECT_EQ(sum, int64_t(100000) * 99999 / 2);
+        // Outside of run() the forks are called in order on this thread.
+        EXPECT_EQ(fork_sum(pool, 0, 1000), 1000 * 999 / 2);
+    }
+}
+
+TEST(ParallelTest, PoolRethrowsAfterBothHalvesFinish) {
+    polyndrom::work_stealing_pool pool(4);
+    std::atomic<int> finished = 0;
+    auto work = [&] {
+        pool.fork_join([&] {
+            throw std::runtime_error("first");
+        }, [&] {
+            fork_sum(pool, 0, 10000);
+            ++finished;
+        });
+    };
+    EXPECT_THROW(pool.run(work), std::runtime_error);
+    EXPECT_EQ(finished, 1);
+    // The pool stays usable after a failed run.
+    int64_t sum = 0;
+    pool.run([&] {
+        sum = fork_sum(pool, 0, 1000);
+    });
+    EXPECT_EQ(sum, 1000 * 999 / 2);
+}
+
+TEST(ParallelTest, ForEachVisitsEveryElementOnce) {
+    polyndrom::acid_map<int, int> map;
+    int_generator generator(0, 1000000);
+    for (int i = 0; i < 50000; i++) {
+        map.emplace(generator.next_value(), 0);
+    }
+    polyndrom::work_stealing_pool pool(4);
+    polyndrom::parallel_for_each(map, [](auto& value) {
+        value.second++;
+    }, pool);
+    std::atomic<int64_t> keys = 0;
+    polyndrom::parallel_for_each(map, [&](auto& value) {
+        keys += value.first;
+    }, pool);
+    int64_t expected_keys = 0;
+    for (auto& [key, value] : map) {
+        EXPECT_EQ(value, 1);
+        expected_keys += key;
+    }
+    EXPECT_EQ(keys, expected_keys);
+    polyndrom::acid_map<int, int> empty;
+    polyndrom::parallel_for_each(empty, [](auto&) {
+        FAIL();
+    }, pool);
+}
+
+TEST(ParallelTest, ReduceKeepsKeyOrder) {
+    polyndrom::acid_map<int, std::string> map;
+    std::string expected = "<";
+    for (int i = 0; i < 20000; i++) {
+        map.emplace(i, std::to_string(i % 10));
+        expected += std::to_string(i % 10);
+    }
+    polyndrom::work_stealing_pool pool(4);
+    auto concat = [](std::string lhs, const std::string& rhs) {
+        return lhs + rhs;
+    };
+    auto mapped = [](const auto& value) {
+        return value.second;
+    };
+    EXPECT_EQ(polyndrom::parallel_reduce(map, std::string("<"), concat, mapped, pool), expected);
+    auto sum = polyndrom::parallel_reduce(map, int64_t(0), std::plus<>(), [](const auto& value) {
+        return int64_t(value.first);
+    }, pool);
+    EXPECT_EQ(sum, int64_t(20000) * 19999 / 2);
+    polyndrom::acid_map<int, std::string> empty;
+    EXPECT_EQ(polyndrom::parallel_reduce(empty, std::string("<"), concat, mapped, pool), "<");
+}
+
+TEST(ParallelTest, SplitRangeMakesEqualChunks) {
+    polyndrom::acid_map<int, int> map;
+    for (int i = 0; i < 1000; i++) {
+        map.emplace(i, i);
+    }
+    for (size_t chunks : {1, 3, 7, 1000, 2000}) {
+        auto first = map.find(100);
+        auto last = map.find(900);
+        auto bounds = polyndrom::split_range(map, first, last, chunks);
+        ASSERT_EQ(bounds.size(), chunks + 1);
+        EXPECT_EQ(bounds.front(), first);
+        EXPECT_EQ(bounds.back(), last);
+        size_t smallest = 800;
+        size_t largest = 0;
+        for (size_t i = 0; i < chunks; i++) {
+            size_t length = map.rank(bounds[i + 1]) - map.rank(bounds[i]);
+            smallest = std::min(smallest, length);
+            largest = std::max(largest, length);
+        }
+        EXPECT_LE(largest - smallest, 1u);
+    }
+    auto whole = polyndrom::split_range(map, map.begin(), map.end(), 4);
+    ASSERT_EQ(whole.size(), 5u);
+    EXPECT_EQ(whole[1]->first, 250);
+    EXPECT_EQ(whole[2]->first, 500);
+    EXPECT_EQ(whole[3]->first, 750);
+    EXPECT_EQ(whole[4], map.end());
+}
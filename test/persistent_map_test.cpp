@@ -0,0 +1,188 @@
+#include "node_pool.hpp"
+#include "persistent_acid_map.hpp"
+#include "utils.hpp"
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+template <class Map, class Expected>
+void expect_same(const Map& map, const Expected& expected) {
+    EXPECT_EQ(map.size(), expected.size());
+    auto expected_it = expected.begin();
+    for (auto& [key, value] : map) {
+        ASSERT_NE(expected_it, expected.end());
+        EXPECT_EQ(key, expected_it->first);
+        EXPECT_EQ(value, expected_it->second);
+        ++expected_it;
+    }
+    EXPECT_EQ(expected_it, expected.end());
+}
+
+TEST(PersistentMapTest, MatchesStdMap) {
+    polyndrom::persistent_acid_map<complex_object, int> map;
+    complex_object_generator generator;
+    std::vector<complex_object> keys;
+    for (int i = 0; i < 3000; i++) {
+        keys.push_back(generator.next_value());
+    }
+    expect_matches_std_map(map, keys, 20000, keys);
+}
+TEST(PersistentMapTest, EmplaceReturnsTheElement) {
+    polyndrom::persistent_acid_map<std::string, int> map;
+    for (int i = 0; i < 1000; i++) {
+        auto [it, inserted] = map.emplace(std::to_string(i), i);
+        EXPECT_TRUE(inserted);
+        EXPECT_EQ(it->second, i);
+    }
+    auto snapshot = map.snapshot();
+    auto [pair_it, pair_inserted] = map.emplace(std::make_pair(std::string("500"), -1));
+    EXPECT_FALSE(pair_inserted);
+    EXPECT_EQ(pair_it->second, 500);
+    auto [piecewise_it, piecewise_inserted] =
+        map.emplace(std::piecewise_construct, std::forward_as_tuple("1000"), std::forward_as_tuple(1000));
+    EXPECT_TRUE(piecewise_inserted);
+    EXPECT_EQ(piecewise_it->first, "1000");
+    ++piecewise_it;
+    EXPECT_EQ(piecewise_it->first, "101");
+    auto [assigned_it, assigned_inserted] = map.insert_or_assign("999", -999);
+    EXPECT_FALSE(assigned_inserted);
+    EXPECT_EQ(assigned_it->second, -999);
+    EXPECT_EQ((++assigned_it), map.end());
+    EXPECT_EQ(map.try_emplace("42", 0).first->second, 42);
+    EXPECT_EQ(snapshot.find("999")->second, 999);
+    EXPECT_FALSE(snapshot.contains("1000"));
+}
+TEST(PersistentMapTest, SnapshotsKeepTheirVersion) {
+    polyndrom::persistent_acid_map<int, int> map;
+    std::vector<polyndrom::persistent_acid_map<int, int>::snapshot_type> snapshots;
+    std::vector<std::map<int, int>> versions;
+    int_generator generator(0, 500);
+    for (int round = 0; round < 20; round++) {
+        snapshots.push_back(map.snapshot());
+        versions.emplace_back(map.begin(), map.end());
+        for (int i = 0; i < 200; i++) {
+            int key = generator.next_value();
+            if (i % 3 == 0) {
+                map.erase(key);
+            } else {
+                map.insert_or_assign(key, round * 1000 + i);
+            }
+        }
+    }
+    for (size_t i = 0; i < snapshots.size(); i++) {
+        expect_same(snapshots[i], versions[i]);
+    }
+    auto it = map.begin();
+    int first = it->first;
+    map.erase(first);
+    EXPECT_EQ(it->first, first);
+    EXPECT_FALSE(map.contains(first));
+    polyndrom::persistent_acid_map<int, int> fork(snapshots[10]);
+    fork.insert_or_assign(-1, -1);
+    expect_same(snapshots[10], versions[10]);
+    EXPECT_EQ(fork.size(), versions[10].size() + 1);
+}
+TEST(PersistentMapTest, ReclaimsNodesOfDroppedSnapshots) {
+    using pool_allocator = polyndrom::node_pool_allocator<std::pair<const int, int>>;
+    pool_allocator allocator;
+    polyndrom::persistent_acid_map<int, int, std::less<int>, pool_allocator> map(allocator);
+    for (int i = 0; i < 1000; i++) {
+        map.emplace(i, i);
+    }
+    EXPECT_EQ(allocator.in_use(), 1000);
+    for (int i = 0; i < 1000; i += 2) {
+        map.insert_or_assign(i, -i);
+    }
+    EXPECT_EQ(allocator.in_use(), 1000);
+    {
+        auto snapshot = map.snapshot();
+        auto copy = map;
+        EXPECT_EQ(allocator.in_use(), 1000);
+        map.insert_or_assign(500, 0);
+        EXPECT_LE(allocator.in_use(), 1000 + 12);
+        for (int i = 0; i < 1000; i += 2) {
+            map.erase(i);
+        }
+        copy.clear();
+        EXPECT_EQ(snapshot.size(), 1000);
+        EXPECT_GT(allocator.in_use(), 1000);
+    }
+    EXPECT_EQ(allocator.in_use(), 500);
+    map.clear();
+    EXPECT_EQ(allocator.in_use(), 0);
+}
+TEST(PersistentMapTest, SnapshotsReadWhileWriting) {
+    polyndrom::persistent_acid_map<int, int> map;
+    int n = 2000;
+    for (int i = 0; i < n; i++) {
+        map.emplace(i, 0);
+    }
+    std::atomic<bool> done{false};
+    std::atomic<int> published{0};
+    std::vector<polyndrom::persistent_acid_map<int, int>::snapshot_type> snapshots;
+    for (int round = 1; round <= 50; round++) {
+        snapshots.push_back(map.snapshot());
+        for (int i = 0; i < n; i += 7) {
+            map.insert_or_assign(i, round);
+        }
+    }
+    std::thread reader([&] {
+        while (!done) {
+            for (int round = 0; round < published; round++) {
+                int count = 0;
+                for (auto& [key, value] : snapshots[round]) {
+                    EXPECT_EQ(value, key % 7 == 0 ? round : 0);
+                    ++count;
+                }
+                EXPECT_EQ(count, n);
+            }
+        }
+    });
+    for (int round = 0; round < 50; round++) {
+        published = round + 1;
+        for (int i = 0; i < n; i++) {
+            map.insert_or_assign(i, -round);
+        }
+    }
+    done = true;
+    reader.join();
+}
+TEST(PersistentMapTest, ErasesFromMapsSharingASnapshot) {
+    polyndrom::persistent_acid_map<int, int> map;
+    int n = 3000;
+    for (int i = 0; i < n; i++) {
+        map.emplace(i, i);
+    }
+    auto snapshot = map.snapshot();
+    map.clear();
+    // Each thread erases every key from its own map over the snapshot's nodes, passing through
+    // nodes with a single shared child, and reads the snapshot in between.
+    auto erase_all = [&](bool ascending) {
+        polyndrom::persistent_acid_map<int, int> own(snapshot);
+        for (int i = 0; i < n; i++) {
+            int key = ascending ? i : n - 1 - i;
+            EXPECT_EQ(own.erase(key), 1);
+            if (i % 100 == 0) {
+                auto it = snapshot.find(key);
+                ASSERT_NE(it, snapshot.end());
+                EXPECT_EQ(it->second, key);
+            }
+        }
+        EXPECT_TRUE(own.empty());
+    };
+    std::thread other(erase_all, false);
+    erase_all(true);
+    other.join();
+    int count = 0;
+    for (auto& [key, value] : snapshot) {
+        EXPECT_EQ(key, count);
+        EXPECT_EQ(value, count);
+        ++count;
+    }
+    EXPECT_EQ(count, n);
+}
@@ -0,0 +1,114 @@
+#include "acid_btree.hpp"
+#include "simd_search.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+// Returns key + offset wrapping around like unsigned arithmetic, so probes next to the extremes are
+// well defined for signed keys too. Floating point keys move to the next representable value.
+template <class Key>
+Key shifted(Key key, int offset) {
+    if constexpr (std::is_floating_point_v<Key>) {
+        return std::nextafter(key, offset < 0 ? -std::numeric_limits<Key>::infinity()
+                                              : std::numeric_limits<Key>::infinity());
+    } else {
+        using unsigned_type = std::make_unsigned_t<Key>;
+        return static_cast<Key>(static_cast<unsigned_type>(key) + static_cast<unsigned_type>(offset));
+    }
+}
+
+// Sorted keys spread over the whole range of Key, including both extremes, so the sign flip of
+// unsigned keys is exercised. Floating point keys are cubes around zero between the infinities.
+template <class Key>
+std::vector<Key> spread_keys(size_t count) {
+    if constexpr (std::is_floating_point_v<Key>) {
+        std::vector<Key> keys;
+        for (size_t i = 0; i < count; i++) {
+            Key x = (static_cast<Key>(i) - static_cast<Key>(count / 2)) * Key(0.75);
+            keys.push_back(x * x * x);
+        }
+        if (count > 1) {
+            keys.front() = -std::numeric_limits<Key>::infinity();
+            keys.back() = std::numeric_limits<Key>::infinity();
+        }
+        return keys;
+    } else {
+        using unsigned_type = std::make_unsigned_t<Key>;
+        unsigned_type low = static_cast<unsigned_type>(std::numeric_limits<Key>::min());
+        unsigned_type step = std::numeric_limits<unsigned_type>::max() / static_cast<unsigned_type>(count + 2);
+        std::vector<Key> keys;
+        for (size_t i = 0; i < count; i++) {
+            keys.push_back(static_cast<Key>(low + static_cast<unsigned_type>(i) * step));
+        }
+        if (count > 0) {
+            keys.back() = std::numeric_limits<Key>::max();
+        }
+        return keys;
+    }
+}
+
+template <class Key>
+void expect_ranks_match_bounds() {
+    if constexpr (polyndrom::is_simd_searchable<Key>::value) {
+        for (size_t count = 0; count <= 64; count++) {
+            std::vector<Key> keys = spread_keys<Key>(count);
+            std::vector<Key> probes = {std::numeric_limits<Key>::lowest(), std::numeric_limits<Key>::max(), 0};
+            if constexpr (std::is_floating_point_v<Key>) {
+                probes.push_back(-Key(0));
+                probes.push_back(std::numeric_limits<Key>::quiet_NaN());
+            }
+            for (Key key : keys) {
+                probes.push_back(key);
+                probes.push_back(shifted(key, -1));
+                probes.push_back(shifted(key, 1));
+            }
+            for (Key probe : probes) {
+                size_t lower = std::lower_bound(keys.begin(), keys.end(), probe) - keys.begin();
+                size_t upper = std::upper_bound(keys.begin(), keys.end(), probe) - keys.begin();
+                ASSERT_EQ(polyndrom::simd_rank<false>(keys.data(), count, probe), lower);
+                ASSERT_EQ(polyndrom::simd_rank<true>(keys.data(), count, probe), upper);
+            }
+        }
+    }
+}
+
+template <class Key>
+void expect_btree_matches_std_map() {
+    polyndrom::acid_btree<Key, int> map;
+    std::vector<Key> keys = spread_keys<Key>(2000);
+    std::vector<Key> probes;
+    for (Key key : keys) {
+        probes.push_back(key);
+        probes.push_back(shifted(key, -1));
+        probes.push_back(shifted(key, 1));
+    }
+    expect_matches_std_map(map, keys, 20000, probes);
+}
+
+TEST(SimdSearchTest, RanksMatchBounds) {
+    expect_ranks_match_bounds<int32_t>();
+    expect_ranks_match_bounds<uint32_t>();
+    expect_ranks_match_bounds<int64_t>();
+    expect_ranks_match_bounds<uint64_t>();
+    expect_ranks_match_bounds<float>();
+    expect_ranks_match_bounds<double>();
+}
+TEST(SimdSearchTest, BTreeWithIntegerKeysMatchesStdMap) {
+    expect_btree_matches_std_map<int32_t>();
+    expect_btree_matches_std_map<uint32_t>();
+    expect_btree_matches_std_map<int64_t>();
+    expect_btree_matches_std_map<uint64_t>();
+}
+TEST(SimdSearchTest, BTreeWithFloatingKeysMatchesStdMap) {
+    static_assert(polyndrom::is_simd_searchable<float>::value == polyndrom::is_simd_searchable<int32_t>::value);
+    static_assert(!polyndrom::is_simd_searchable<long double>::value);
+    expect_btree_matches_std_map<float>();
+    expect_btree_matches_std_map<double>();
+}
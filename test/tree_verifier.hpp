@@ -12,10 +12,46 @@ bool verify_tree(const Tree& tree, std::ostream& fails_ostream = std::cout);
 template <class Tree>
 class tree_verifier {
 public:
-    using node_ptr = typename Tree::node_ptr;
+    using node_ptr = typename Tree::node_type*;
     tree_verifier(const Tree& tree, std::ostream& fails_ostream) : tree(tree), fails_ostream(fails_ostream) {}
     bool verify() {
-        return verify_node(tree.root);
+        size_t root_size = tree.root == nullptr ? 0 : tree.root->size;
+        if (root_size != tree.map_size) {
+            fails_ostream << "root size map size " << root_size << " " << tree.map_size << std::endl;
+            return false;
+        }
+        if (!verify_node(tree.root)) {
+            return false;
+        }
+        if constexpr (Tree::threaded) {
+            return verify_links();
+        }
+        return true;
+    }
+    // The successor and predecessor links of threaded trees have to follow the in-order walk.
+    bool verify_links() {
+        node_ptr previous = nullptr;
+        for (node_ptr node = tree.root == nullptr ? nullptr : Tree::node_type::min(tree.root); node != nullptr;
+             node = Tree::node_type::next(node)) {
+            if (node->predecessor != previous) {
+                fails_ostream << "predecessor of node " << node->value.first << std::endl;
+                return false;
+            }
+            node_ptr expected = node->right != nullptr ? Tree::node_type::min(node->right)
+                                                       : Tree::node_type::nearest_left_ancestor(node);
+            if (node->successor != expected) {
+                fails_ostream << "successor of node " << node->value.first << std::endl;
+                return false;
+            }
+            previous = node;
+        }
+        return true;
+    }
+    size_t deep_size(node_ptr node) {
+        if (node == nullptr) {
+            return 0;
+        }
+        return deep_size(node->left) + deep_size(node->right) + 1;
     }
     int deep_height(node_ptr node) {
         if (node == nullptr) {
@@ -65,6 +101,14 @@ public:
             fails_ostream << "node lh rh " << node->value.first << " " << lheight << " " << rheight << std::endl;
             return false;
         }
+        if (node->height != std::max(lheight, rheight) + 2) {
+            fails_ostream << "node height " << node->value.first << " " << int(node->height) << std::endl;
+            return false;
+        }
+        if (node->size != deep_size(node->left) + deep_size(node->right) + 1) {
+            fails_ostream << "node size " << node->value.first << " " << node->size << std::endl;
+            return false;
+        }
         return verify_node(left) && verify_node(right);
     }
     const Tree& tree;
@@ -24,11 +24,11 @@ complex_object::complex_object(int num, std::string&& str) : num_(num), str_(std
 complex_object::complex_object(int num, const std::string& str) : num_(num), str_(str), has_emplaced_(true) {}
 
 bool complex_object::operator<(const complex_object& rhs) const {
-    return std::make_tuple(num_, str_) < std::make_tuple(rhs.num_, rhs.str_);
+    return std::tie(num_, str_) < std::tie(rhs.num_, rhs.str_);
 }
 
 bool complex_object::operator==(const complex_object& rhs) const {
-    return std::make_tuple(num_, str_) == std::make_tuple(rhs.num_, rhs.str_);
+    return std::tie(num_, str_) == std::tie(rhs.num_, rhs.str_);
 }
 
 bool complex_object::has_copied() const {
@@ -58,24 +58,31 @@ std::ostream& operator<<(std::ostream& os, const complex_object& key) {
     return os;
 }
 
-int_generator::int_generator(int start, int end) : distribution_(start, end) {}
+unsigned random_seed() {
+    static std::random_device device;
+    return device();
+}
+
+int_generator::int_generator(int start, int end, unsigned seed) : engine_(seed), distribution_(start, end) {}
 
 int int_generator::next_value() {
-    return distribution_(device_);
+    return distribution_(engine_);
 }
 
-string_generator::string_generator(int min_len, int max_len) : len_distribution_(min_len, max_len), char_distribution_('a', 'z') {}
+string_generator::string_generator(int min_len, int max_len, unsigned seed)
+    : engine_(seed), len_distribution_(min_len, max_len), char_distribution_('a', 'z') {}
 
 std::string string_generator::next_value() {
-    int len = len_distribution_(device_);
+    int len = len_distribution_(engine_);
     std::string result(len, ' ');
     for (char& ch : result) {
-        ch = char_distribution_(device_);
+        ch = char_distribution_(engine_);
     }
     return result;
 }
 
-complex_object_generator::complex_object_generator() : int_generator_(0, 1), string_generator_(100, 100) {}
+complex_object_generator::complex_object_generator(unsigned seed)
+    : int_generator_(0, 1, seed), string_generator_(100, 100, seed + 1) {}
 
 complex_object complex_object_generator::next_value() {
     complex_object object(int_generator_.next_value(), string_generator_.next_value());
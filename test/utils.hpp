@@ -3,7 +3,13 @@
 #include <random>
 #include <string>
 #include <algorithm>
+#include <map>
 #include <ostream>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "gtest/gtest.h"
 
 class complex_object {
 public:
@@ -30,40 +36,125 @@ public:
 
 std::ostream& operator<<(std::ostream& os, const complex_object& key);
 
+unsigned random_seed();
+
 class int_generator {
 public:
-    int_generator(int start, int end);
+    int_generator(int start, int end, unsigned seed = random_seed());
     int next_value();
 private:
-    std::random_device device_;
+    std::mt19937 engine_;
     std::uniform_int_distribution<int> distribution_;
 };
 
 class string_generator {
 public:
-    string_generator(int min_len, int max_len);
+    string_generator(int min_len, int max_len, unsigned seed = random_seed());
     std::string next_value();
 private:
-    std::random_device device_;
+    std::mt19937 engine_;
     std::uniform_int_distribution<int> len_distribution_;
     std::uniform_int_distribution<int> char_distribution_;
 };
 
 class complex_object_generator {
 public:
-    complex_object_generator();
+    complex_object_generator(unsigned seed = random_seed());
     complex_object next_value();
 private:
     int_generator int_generator_;
     string_generator string_generator_;
 };
 
+template <class C, class = void>
+struct has_nth : std::false_type {};
+
+template <class C>
+struct has_nth<C, std::void_t<decltype(std::declval<C&>().nth(0))>> : std::true_type {};
+
 template <class C>
 typename C::iterator random_element(C& c) {
     int_generator generator(0, (int) c.size() - 1);
-    auto it = c.begin();
-    std::advance(it, generator.next_value());
-    return it;
+    if constexpr (has_nth<C>::value) {
+        return c.nth(generator.next_value());
+    } else {
+        auto it = c.begin();
+        std::advance(it, generator.next_value());
+        return it;
+    }
 }
 
 complex_object make_unique_object(complex_object_generator& objects_generator);
+
+template <class C, class = void>
+struct has_upper_bound : std::false_type {};
+
+template <class C>
+struct has_upper_bound<C, std::void_t<decltype(std::declval<C&>().upper_bound(
+                              std::declval<const typename C::key_type&>()))>> : std::true_type {};
+
+template <class R>
+bool was_inserted(const R& result) {
+    if constexpr (std::is_same_v<R, bool>) {
+        return result;
+    } else {
+        return result.second;
+    }
+}
+
+// Runs count random erase, insert_or_assign, try_emplace and emplace calls with keys picked from keys
+// on map and on a std::map, then checks that both hold the same elements and agree on find, lower_bound
+// and, if map has it, upper_bound for every probe.
+template <class Map, class Key>
+void expect_matches_std_map(Map& map, const std::vector<Key>& keys, int count, const std::vector<Key>& probes) {
+    std::map<Key, int> expected;
+    int_generator index(0, (int) keys.size() - 1);
+    for (int i = 0; i < count; i++) {
+        const Key& key = keys[index.next_value()];
+        switch (i % 5) {
+            case 0:
+            case 1:
+                EXPECT_EQ(map.erase(key), expected.erase(key));
+                break;
+            case 2:
+                EXPECT_EQ(was_inserted(map.insert_or_assign(key, i)), expected.insert_or_assign(key, i).second);
+                break;
+            case 3:
+                EXPECT_EQ(was_inserted(map.try_emplace(key, i)), expected.try_emplace(key, i).second);
+                break;
+            default:
+                EXPECT_EQ(was_inserted(map.emplace(key, i)), expected.emplace(key, i).second);
+        }
+    }
+    EXPECT_EQ(map.size(), expected.size());
+    auto expected_it = expected.begin();
+    for (auto& [key, value] : map) {
+        ASSERT_NE(expected_it, expected.end());
+        EXPECT_EQ(key, expected_it->first);
+        EXPECT_EQ(value, expected_it->second);
+        ++expected_it;
+    }
+    EXPECT_EQ(expected_it, expected.end());
+    for (const Key& probe : probes) {
+        auto it = map.find(probe);
+        auto expected_found = expected.find(probe);
+        ASSERT_EQ(it == map.end(), expected_found == expected.end());
+        if (it != map.end()) {
+            EXPECT_EQ(it->second, expected_found->second);
+        }
+        auto lower = map.lower_bound(probe);
+        auto expected_lower = expected.lower_bound(probe);
+        ASSERT_EQ(lower == map.end(), expected_lower == expected.end());
+        if (lower != map.end()) {
+            EXPECT_EQ(lower->first, expected_lower->first);
+        }
+        if constexpr (has_upper_bound<Map>::value) {
+            auto upper = map.upper_bound(probe);
+            auto expected_upper = expected.upper_bound(probe);
+            ASSERT_EQ(upper == map.end(), expected_upper == expected.end());
+            if (upper != map.end()) {
+                EXPECT_EQ(upper->first, expected_upper->first);
+            }
+        }
+    }
+}